@@ -0,0 +1,81 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include "cancellation-scope.h"
+
+namespace capture_thread {
+namespace testing {
+
+CancellationScope::CancellationScope()
+    : state_(new State(GetCurrent() ? GetCurrent()->state_ : nullptr)),
+      cross_and_capture_to_(this) {}
+
+CancellationScope::~CancellationScope() {
+  Cancel();
+  // Callbacks increment executing *before* checking cancelled, so once
+  // cancelled is set, executing can only decrease.
+  std::unique_lock<std::mutex> lock(state_->executing_lock);
+  while (state_->executing.load() > 0) {
+    state_->executing_wait.wait(lock);
+  }
+}
+
+void CancellationScope::Cancel() { state_->cancelled.store(true); }
+
+// static
+std::function<void()> CancellationScope::WrapCall(std::function<void()> call) {
+  auto wrapped = ThreadCrosser::WrapCall(std::move(call));
+  if (!wrapped || !GetCurrent()) {
+    return wrapped;
+  }
+  const std::shared_ptr<State> state = GetCurrent()->state_;
+  return [state, wrapped] { CallUnlessCancelled(state, wrapped); };
+}
+
+// static
+bool CancellationScope::IsCancelled() {
+  return GetCurrent() && GetCurrent()->state_->IsCancelled();
+}
+
+// static
+void CancellationScope::CallUnlessCancelled(
+    const std::shared_ptr<State>& state, const std::function<void()>& call) {
+  state->executing.fetch_add(1);
+  // The check is done without dereferencing anything that belongs to the scope
+  // itself, since the scope might have already been destroyed.
+  if (!state->IsCancelled()) {
+    call();
+  }
+  if (state->executing.fetch_sub(1) == 1 && state->cancelled.load()) {
+    std::lock_guard<std::mutex> lock(state->executing_lock);
+    state->executing_wait.notify_all();
+  }
+}
+
+bool CancellationScope::State::IsCancelled() const {
+  // Scopes are rarely nested more than a few levels deep.
+  for (const State* state = this; state; state = state->parent.get()) {
+    if (state->cancelled.load()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace testing
+}  // namespace capture_thread
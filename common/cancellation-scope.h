@@ -0,0 +1,103 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef CANCELLATION_SCOPE_H_
+#define CANCELLATION_SCOPE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "thread-capture.h"
+#include "thread-crosser.h"
+
+namespace capture_thread {
+namespace testing {
+
+// Groups callbacks that are queued while the scope is active, so that they can
+// be skipped once the work they belong to is no longer needed. Callbacks must
+// be wrapped with CancellationScope::WrapCall (instead of ThreadCrosser) to be
+// part of the group. For example:
+//
+//   {
+//     CancellationScope request;
+//     queue.Push(CancellationScope::WrapCall(&ProcessPart1));
+//     queue.Push(CancellationScope::WrapCall(&ProcessPart2));
+//     if (!WaitForCompletion(deadline)) {
+//       return;  // Pending callbacks are skipped when request goes away.
+//     }
+//   }
+//
+// This also makes it safe for the scope, and any instrumentation constructed
+// *before* it, to go out of scope while its callbacks are still queued; the
+// destructor waits for any of its callbacks that are already executing.
+// Instrumentation constructed after the scope (e.g., a LogTextMultiThread
+// declared below it in the same block) is destroyed before the callbacks are
+// cancelled, so a callback that starts in between can still use it. The
+// CancellationScope should therefore be the innermost instrumentation.
+class CancellationScope : public ThreadCapture<CancellationScope> {
+ public:
+  CancellationScope();
+
+  // Cancels all pending callbacks in the group, then waits for the callbacks
+  // that are already executing to return.
+  ~CancellationScope();
+
+  // Cancels pending callbacks without leaving the scope, e.g., when a client
+  // disconnects or a deadline passes.
+  void Cancel();
+
+  // Wraps a callback like ThreadCrosser::WrapCall. If a CancellationScope is
+  // in scope, the returned callback becomes a no-op once that scope, or any
+  // scope enclosing it, is cancelled or destroyed. The check walks the chain
+  // of enclosing scopes, so it takes time proportional to their nesting depth.
+  static std::function<void()> WrapCall(std::function<void()> call);
+
+  // Returns true if the current scope, or any scope enclosing it, has been
+  // cancelled. Long-running callbacks can check this to return early. Like
+  // the check in WrapCall, this is O(depth) in the nesting of the scopes.
+  static bool IsCancelled();
+
+ private:
+  // Shared with wrapped callbacks, since they might outlive the scope.
+  struct State {
+    explicit State(std::shared_ptr<State> new_parent)
+        : parent(std::move(new_parent)) {}
+
+    bool IsCancelled() const;
+
+    const std::shared_ptr<State> parent;
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> executing{0};
+    std::mutex executing_lock;
+    std::condition_variable executing_wait;
+  };
+
+  static void CallUnlessCancelled(const std::shared_ptr<State>& state,
+                                  const std::function<void()>& call);
+
+  const std::shared_ptr<State> state_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // CANCELLATION_SCOPE_H_
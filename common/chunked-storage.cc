@@ -0,0 +1,74 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include "chunked-storage.h"
+
+namespace capture_thread {
+namespace testing {
+
+LineList::LineList(const LineList& other) {
+  // Copies are compacted into as few blocks as possible.
+  for (const LineView& line : other) {
+    Append(line.data(), line.size());
+  }
+}
+
+void LineList::Append(const char* data, std::size_t size) {
+  if (size > block_remaining_) {
+    // Lines that are larger than a block get their own block, so that the rest
+    // of the current block isn't wasted.
+    std::size_t block_size = kBlockSize;
+    if (size > block_size) {
+      block_size = size;
+    }
+    blocks_.emplace_back(new char[block_size]);
+    if (block_size == kBlockSize) {
+      block_position_ = blocks_.back().get();
+      block_remaining_ = kBlockSize;
+    } else {
+      if (size > 0) {
+        std::memcpy(blocks_.back().get(), data, size);
+      }
+      lines_.emplace_back(blocks_.back().get(), size);
+      return;
+    }
+  }
+  if (size > 0) {
+    std::memcpy(block_position_, data, size);
+  }
+  lines_.emplace_back(block_position_, size);
+  block_position_ += size;
+  block_remaining_ -= size;
+}
+
+void LineList::clear() {
+  lines_.clear();
+  blocks_.clear();
+  block_position_ = nullptr;
+  block_remaining_ = 0;
+}
+
+void LineList::swap(LineList& other) {
+  lines_.swap(other.lines_);
+  blocks_.swap(other.blocks_);
+  std::swap(block_position_, other.block_position_);
+  std::swap(block_remaining_, other.block_remaining_);
+}
+
+}  // namespace testing
+}  // namespace capture_thread
@@ -0,0 +1,266 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef CHUNKED_STORAGE_H_
+#define CHUNKED_STORAGE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace capture_thread {
+namespace testing {
+
+// Append-only sequence stored in fixed-size chunks. Unlike std::vector,
+// appending never moves existing elements, so references remain valid. Unlike
+// std::list, there is one allocation per chunk rather than per element, and
+// iteration is mostly sequential in memory.
+template <class Type, int kChunkSize = 64>
+class ChunkedList {
+ private:
+  struct Chunk;
+
+ public:
+  using value_type = Type;
+  using size_type = std::size_t;
+  using reference = Type&;
+  using const_reference = const Type&;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Type*;
+    using reference = const Type&;
+
+    const_iterator() = default;
+
+    const Type& operator*() const { return chunk_->at(index_); }
+    const Type* operator->() const { return &chunk_->at(index_); }
+
+    const_iterator& operator++() {
+      if (++index_ == chunk_->size && chunk_->next) {
+        chunk_ = chunk_->next;
+        index_ = 0;
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return chunk_ == other.chunk_ && index_ == other.index_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const_iterator(const Chunk* chunk, int index)
+        : chunk_(chunk), index_(index) {}
+
+    friend class ChunkedList;
+    const Chunk* chunk_ = nullptr;
+    int index_ = 0;
+  };
+
+  using iterator = const_iterator;
+
+  ChunkedList() = default;
+
+  ChunkedList(const ChunkedList& other) {
+    for (const Type& value : other) {
+      emplace_back(value);
+    }
+  }
+
+  ChunkedList(ChunkedList&& other) { swap(other); }
+
+  ChunkedList& operator=(ChunkedList other) {
+    swap(other);
+    return *this;
+  }
+
+  ~ChunkedList() { clear(); }
+
+  template <class... Args>
+  Type& emplace_back(Args&&... args) {
+    if (!last_ || last_->size == kChunkSize) {
+      Chunk* const chunk = new Chunk;
+      (last_ ? last_->next : first_) = chunk;
+      last_ = chunk;
+    }
+    Type* const value =
+        new (&last_->values[last_->size]) Type(std::forward<Args>(args)...);
+    ++last_->size;
+    ++size_;
+    return *value;
+  }
+
+  void clear() {
+    // Iterative, since a recursive destructor could overflow the stack.
+    while (first_) {
+      Chunk* const next = first_->next;
+      delete first_;
+      first_ = next;
+    }
+    last_ = nullptr;
+    size_ = 0;
+  }
+
+  void swap(ChunkedList& other) {
+    std::swap(first_, other.first_);
+    std::swap(last_, other.last_);
+    std::swap(size_, other.size_);
+  }
+
+  size_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const Type& front() const { return first_->at(0); }
+  const Type& back() const { return last_->at(last_->size - 1); }
+
+  const_iterator begin() const { return const_iterator(first_, 0); }
+  const_iterator end() const {
+    return last_ ? const_iterator(last_, last_->size) : const_iterator();
+  }
+
+ private:
+  struct Chunk {
+    Chunk() = default;
+    ~Chunk() {
+      for (int i = 0; i < size; ++i) {
+        at(i).~Type();
+      }
+    }
+
+    Type& at(int index) { return *reinterpret_cast<Type*>(&values[index]); }
+    const Type& at(int index) const {
+      return *reinterpret_cast<const Type*>(&values[index]);
+    }
+
+    // Raw storage, so that only elements that have been appended are
+    // constructed.
+    typename std::aligned_storage<sizeof(Type), alignof(Type)>::type
+        values[kChunkSize];
+    int size = 0;
+    Chunk* next = nullptr;
+  };
+
+  Chunk* first_ = nullptr;
+  Chunk* last_ = nullptr;
+  size_type size_ = 0;
+};
+
+// Non-owning reference to a line of text stored elsewhere, e.g., in LineList.
+class LineView {
+ public:
+  LineView(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  std::string str() const { return std::string(data_, size_); }
+  operator std::string() const { return str(); }
+
+  bool operator==(const LineView& other) const {
+    return size_ == other.size_ &&
+           (size_ == 0 || std::memcmp(data_, other.data_, size_) == 0);
+  }
+  bool operator==(const std::string& other) const {
+    return *this == LineView(other.data(), other.size());
+  }
+  bool operator==(const char* other) const {
+    return *this == LineView(other, std::strlen(other));
+  }
+
+  template <class Other>
+  bool operator!=(const Other& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  const char* data_;
+  std::size_t size_;
+};
+
+inline std::ostream& operator<<(std::ostream& output, const LineView& line) {
+  return output.write(line.data(), line.size());
+}
+
+// Append-only list of lines of text. The characters of all lines are packed
+// into large blocks owned by the list, rather than using one heap allocation
+// per line. Lines are accessed as LineView, which remain valid until the list
+// is cleared or destroyed.
+class LineList {
+ public:
+  using value_type = LineView;
+  using size_type = std::size_t;
+  using const_iterator = ChunkedList<LineView>::const_iterator;
+  using iterator = const_iterator;
+
+  LineList() = default;
+  LineList(const LineList& other);
+  LineList(LineList&& other) { swap(other); }
+
+  LineList& operator=(LineList other) {
+    swap(other);
+    return *this;
+  }
+
+  void Append(const char* data, std::size_t size);
+  void Append(const std::string& line) { Append(line.data(), line.size()); }
+
+  void clear();
+  void swap(LineList& other);
+
+  size_type size() const { return lines_.size(); }
+  bool empty() const { return lines_.empty(); }
+
+  const LineView& front() const { return lines_.front(); }
+  const LineView& back() const { return lines_.back(); }
+
+  const_iterator begin() const { return lines_.begin(); }
+  const_iterator end() const { return lines_.end(); }
+
+ private:
+  static constexpr std::size_t kBlockSize = 4096;
+
+  ChunkedList<LineView> lines_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* block_position_ = nullptr;
+  std::size_t block_remaining_ = 0;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // CHUNKED_STORAGE_H_
@@ -0,0 +1,68 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#include "log-stamp.h"
+
+namespace capture_thread {
+namespace testing {
+
+namespace {
+
+std::int64_t CurrentTimeNs() {
+#ifdef CLOCK_MONOTONIC_COARSE
+  timespec time;
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &time) == 0) {
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+  }
+#endif
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+// static
+std::uint32_t LogStamp::CurrentThread() {
+  static std::atomic<std::uint32_t> next_thread(1);
+  thread_local const std::uint32_t thread =
+      next_thread.fetch_add(1, std::memory_order_relaxed);
+  return thread;
+}
+
+// static
+LogStamp LogStamp::Now() { return LogStamp{CurrentTimeNs(), CurrentThread()}; }
+
+void LogStamp::AppendTo(std::string* output) const {
+  char formatted[64];
+  const int size = std::snprintf(
+      formatted, sizeof formatted, "[%lld.%06lld T%lu] ",
+      static_cast<long long>(time_ns / 1000000000),
+      static_cast<long long>(time_ns % 1000000000 / 1000),
+      static_cast<unsigned long>(thread));
+  output->append(formatted, size);
+}
+
+}  // namespace testing
+}  // namespace capture_thread
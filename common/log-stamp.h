@@ -0,0 +1,53 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef LOG_STAMP_H_
+#define LOG_STAMP_H_
+
+#include <cstdint>
+#include <string>
+
+namespace capture_thread {
+namespace testing {
+
+// Time and thread of a log entry, kept in binary form until it's rendered.
+// Getting a stamp doesn't take any locks or allocate, and is much cheaper than
+// formatting a time at each call site.
+struct LogStamp {
+  // Returns a stamp for the current time and thread. The time comes from
+  // CLOCK_MONOTONIC_COARSE where available, which is read without a syscall,
+  // but only has a resolution of a few milliseconds.
+  static LogStamp Now();
+
+  // Returns the value of thread that Now would use for the calling thread.
+  static std::uint32_t CurrentThread();
+
+  // Appends the stamp as text, e.g., "[12.345678 T3] ".
+  void AppendTo(std::string* output) const;
+
+  // Monotonic time since an arbitrary point.
+  std::int64_t time_ns;
+  // Sequential ID of the thread, starting at 1, assigned when the thread first
+  // gets a stamp. Unlike std::thread::id, this is short enough to print.
+  std::uint32_t thread;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // LOG_STAMP_H_
@@ -16,26 +16,344 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
 #include "log-text.h"
+#include "lz-codec.h"
 
 namespace capture_thread {
 namespace testing {
 
-// static
-void LogText::Log(std::string line) {
-  if (GetCurrent()) {
-    GetCurrent()->LogLine(std::move(line));
+LineList LogTextMultiThread::GetLines() {
+  std::lock_guard<std::mutex> lock(data_lock_);
+  return lines_;
+}
+
+LineList LogTextMultiThread::Drain() {
+  LineList lines;
+  std::lock_guard<std::mutex> lock(data_lock_);
+  lines.swap(lines_);
+  return lines;
+}
+
+void LogTextMultiThread::LogLine(const LineView& line) {
+  std::lock_guard<std::mutex> lock(data_lock_);
+  lines_.Append(line.data(), line.size());
+}
+
+// Single-producer, single-consumer queue of lines, stored in linked chunks. The
+// thread that owns the buffer appends without locking; readers only see entries
+// that have been published via written_.
+class LogTextPerThread::ThreadLines {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    Clock::time_point time;
+    LogStamp stamp;
+    std::string line;
+  };
+
+  ThreadLines() : head_(new Chunk), tail_(head_) {}
+
+  ~ThreadLines() {
+    while (head_) {
+      Chunk* const next = head_->next.load(std::memory_order_relaxed);
+      delete head_;
+      head_ = next;
+    }
+  }
+
+  // Must only be called by the owning thread.
+  void Append(Clock::time_point time, const LogStamp& stamp,
+              const LineView& line) {
+    if (tail_index_ == kChunkSize) {
+      Chunk* const chunk = new Chunk;
+      tail_->next.store(chunk, std::memory_order_release);
+      tail_ = chunk;
+      tail_index_ = 0;
+    }
+    Entry& entry = tail_->entries[tail_index_++];
+    entry.time = time;
+    entry.stamp = stamp;
+    entry.line.assign(line.data(), line.size());
+    written_.store(written_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
   }
+
+  // Calls visit with each unread entry. If consume is true, the entries are
+  // marked as read, and visit may move from them. Readers must be serialized.
+  template <class Visit>
+  void Read(bool consume, Visit visit) {
+    const std::uint64_t available = written_.load(std::memory_order_acquire);
+    Chunk* chunk = head_;
+    int index = head_index_;
+    for (std::uint64_t position = read_; position < available; ++position) {
+      if (index == kChunkSize) {
+        Chunk* const next = chunk->next.load(std::memory_order_acquire);
+        assert(next);
+        if (consume) {
+          // The writer moved past this chunk before publishing the next entry.
+          delete chunk;
+        }
+        chunk = next;
+        index = 0;
+      }
+      visit(chunk->entries[index++]);
+    }
+    if (consume) {
+      head_ = chunk;
+      head_index_ = index;
+      read_ = available;
+    }
+  }
+
+ private:
+  static constexpr int kChunkSize = 64;
+
+  struct Chunk {
+    Entry entries[kChunkSize];
+    std::atomic<Chunk*> next{nullptr};
+  };
+
+  // Reader state.
+  Chunk* head_;
+  int head_index_ = 0;
+  std::uint64_t read_ = 0;
+  // Writer state.
+  Chunk* tail_;
+  int tail_index_ = 0;
+  std::atomic<std::uint64_t> written_{0};
+};
+
+LogTextPerThread::LogTextPerThread(bool ordered, bool stamped)
+    : ordered_(ordered), stamped_(stamped), cross_and_capture_to_(this) {}
+
+LogTextPerThread::~LogTextPerThread() = default;
+
+LineList LogTextPerThread::GetLines() { return Merge(false); }
+
+LineList LogTextPerThread::Drain() { return Merge(true); }
+
+void LogTextPerThread::LogLine(const LineView& line) {
+  threads_.Local().Append(
+      ordered_ ? ThreadLines::Clock::now() : ThreadLines::Clock::time_point(),
+      stamped_ ? LogStamp::Now() : LogStamp(), line);
+}
+
+LineList LogTextPerThread::Merge(bool consume) {
+  std::lock_guard<std::mutex> lock(read_lock_);
+  // Stamps are only rendered here, rather than when the line is logged.
+  const auto stamped_line = [](const ThreadLines::Entry& entry) {
+    std::string line;
+    entry.stamp.AppendTo(&line);
+    line.append(entry.line);
+    return line;
+  };
+  LineList lines;
+  if (ordered_) {
+    std::vector<std::pair<ThreadLines::Clock::time_point, std::string>> merged;
+    threads_.ForEach([this, consume, &merged,
+                      &stamped_line](ThreadLines& thread) {
+      thread.Read(consume, [this, consume, &merged,
+                            &stamped_line](ThreadLines::Entry& entry) {
+        if (stamped_) {
+          merged.emplace_back(entry.time, stamped_line(entry));
+        } else {
+          merged.emplace_back(entry.time,
+                              consume ? std::move(entry.line) : entry.line);
+        }
+      });
+    });
+    // Stable, so that lines with the same timestamp keep their per-thread
+    // order.
+    std::stable_sort(
+        merged.begin(), merged.end(),
+        [](const std::pair<ThreadLines::Clock::time_point, std::string>& left,
+           const std::pair<ThreadLines::Clock::time_point, std::string>&
+               right) { return left.first < right.first; });
+    for (const auto& entry : merged) {
+      lines.Append(entry.second);
+    }
+  } else {
+    threads_.ForEach([this, consume, &lines,
+                      &stamped_line](ThreadLines& thread) {
+      thread.Read(consume, [this, &lines,
+                            &stamped_line](const ThreadLines::Entry& entry) {
+        if (stamped_) {
+          lines.Append(stamped_line(entry));
+        } else {
+          lines.Append(entry.line);
+        }
+      });
+    });
+  }
+  return lines;
+}
+
+LogTextRing::LogTextRing(std::size_t max_lines, std::size_t max_bytes)
+    : max_lines_(max_lines),
+      max_bytes_(max_bytes),
+      entries_(new Entry[max_lines]),
+      text_(new char[max_bytes]),
+      cross_and_capture_to_(this) {
+  assert(max_lines_ > 0);
+  assert(max_bytes_ > 0);
 }
 
-std::list<std::string> LogTextMultiThread::GetLines() {
+LineList LogTextRing::GetLines() {
+  LineList lines;
+  // Used for lines that wrap around the end of the text buffer.
+  std::string wrapped;
   std::lock_guard<std::mutex> lock(data_lock_);
-  return lines_;
+  for (std::size_t i = 0; i < entry_count_; ++i) {
+    const Entry& entry = entries_[(first_entry_ + i) % max_lines_];
+    const std::size_t before_end = max_bytes_ - entry.offset;
+    if (entry.size <= before_end) {
+      lines.Append(&text_[entry.offset], entry.size);
+    } else {
+      wrapped.assign(&text_[entry.offset], before_end);
+      wrapped.append(&text_[0], entry.size - before_end);
+      lines.Append(wrapped);
+    }
+  }
+  return lines;
+}
+
+std::uint64_t LogTextRing::GetOverwritten() {
+  std::lock_guard<std::mutex> lock(data_lock_);
+  return overwritten_;
 }
 
-void LogTextMultiThread::LogLine(std::string line) {
+void LogTextRing::LogLine(const LineView& line) {
+  const std::size_t size = std::min(line.size(), max_bytes_);
   std::lock_guard<std::mutex> lock(data_lock_);
-  lines_.emplace_back(std::move(line));
+  while (entry_count_ == max_lines_ || byte_count_ + size > max_bytes_) {
+    DropOldest();
+  }
+  const std::size_t offset = (first_byte_ + byte_count_) % max_bytes_;
+  const std::size_t before_end = std::min(size, max_bytes_ - offset);
+  std::memcpy(&text_[offset], line.data(), before_end);
+  std::memcpy(&text_[0], line.data() + before_end, size - before_end);
+  entries_[(first_entry_ + entry_count_) % max_lines_] = Entry{offset, size};
+  ++entry_count_;
+  byte_count_ += size;
+}
+
+void LogTextRing::DropOldest() {
+  assert(entry_count_ > 0);
+  const Entry& oldest = entries_[first_entry_];
+  first_byte_ = (oldest.offset + oldest.size) % max_bytes_;
+  byte_count_ -= oldest.size;
+  first_entry_ = (first_entry_ + 1) % max_lines_;
+  --entry_count_;
+  ++overwritten_;
+}
+
+namespace {
+
+void AppendChunkLines(const std::string& data, LineList* lines) {
+  std::size_t position = 0;
+  while (position < data.size()) {
+    std::uint32_t size;
+    std::memcpy(&size, data.data() + position, sizeof size);
+    position += sizeof size;
+    lines->Append(data.data() + position, size);
+    position += size;
+  }
+}
+
+}  // namespace
+
+LogTextCompressed::LogTextCompressed(std::size_t chunk_size)
+    : chunk_size_(chunk_size),
+      compressor_(&LogTextCompressed::CompressorThread, this),
+      cross_and_capture_to_(this) {}
+
+LogTextCompressed::~LogTextCompressed() {
+  {
+    std::lock_guard<std::mutex> lock(data_lock_);
+    terminated_ = true;
+    compressor_wait_.notify_all();
+  }
+  compressor_.join();
+}
+
+LineList LogTextCompressed::GetLines() {
+  LineList lines;
+  std::lock_guard<std::mutex> lock(data_lock_);
+  std::string decompressed;
+  for (const Chunk& chunk : chunks_) {
+    if (chunk.compressed) {
+      decompressed.clear();
+      const bool valid =
+          LzDecompress(chunk.data.data(), chunk.data.size(), &decompressed);
+      assert(valid);
+      (void)valid;
+      AppendChunkLines(decompressed, &lines);
+    } else {
+      AppendChunkLines(chunk.data, &lines);
+    }
+  }
+  AppendChunkLines(open_chunk_, &lines);
+  return lines;
+}
+
+std::size_t LogTextCompressed::GetStoredBytes() {
+  std::lock_guard<std::mutex> lock(data_lock_);
+  std::size_t bytes = open_chunk_.size();
+  for (const Chunk& chunk : chunks_) {
+    bytes += chunk.data.size();
+  }
+  return bytes;
+}
+
+void LogTextCompressed::LogLine(const LineView& line) {
+  const std::uint32_t size = line.size();
+  char header[sizeof size];
+  std::memcpy(header, &size, sizeof size);
+  std::lock_guard<std::mutex> lock(data_lock_);
+  open_chunk_.append(header, sizeof header);
+  open_chunk_.append(line.data(), line.size());
+  if (open_chunk_.size() >= chunk_size_) {
+    chunks_.emplace_back();
+    chunks_.back().data.swap(open_chunk_);
+    if (next_pending_ == chunks_.end()) {
+      next_pending_ = std::prev(chunks_.end());
+    }
+    compressor_wait_.notify_all();
+  }
+}
+
+void LogTextCompressed::CompressorThread() {
+  std::unique_lock<std::mutex> lock(data_lock_);
+  while (true) {
+    while (!terminated_ && next_pending_ == chunks_.end()) {
+      compressor_wait_.wait(lock);
+    }
+    if (terminated_) {
+      break;
+    }
+    Chunk& chunk = *next_pending_;
+    lock.unlock();
+    // The chunk can still be read by GetLines in the meantime.
+    std::string compressed;
+    LzCompress(chunk.data.data(), chunk.data.size(), &compressed);
+    lock.lock();
+    if (compressed.size() < chunk.data.size()) {
+      compressed.shrink_to_fit();
+      chunk.data.swap(compressed);
+      chunk.compressed = true;
+    }
+    ++next_pending_;
+  }
 }
 
 }  // namespace testing
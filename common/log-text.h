@@ -19,10 +19,20 @@ limitations under the License.
 #ifndef LOG_TEXT_H_
 #define LOG_TEXT_H_
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 
+#include "chunked-storage.h"
+#include "log-stamp.h"
+#include "mapped-log-file.h"
+#include "per-thread.h"
 #include "thread-capture.h"
 #include "thread-crosser.h"
 
@@ -32,7 +42,22 @@ namespace testing {
 // Captures text log entries.
 class LogText : public ThreadCapture<LogText> {
  public:
-  static void Log(std::string line);
+  // None of the overloads copy the line unless the capture in scope stores it,
+  // and they do nothing at all if no capture is in scope.
+  static void Log(const std::string& line) {
+    Log(LineView(line.data(), line.size()));
+  }
+
+  // The length of a string literal is computed at compile time once this is
+  // inlined.
+  static void Log(const char* line) { Log(LineView(line, std::strlen(line))); }
+
+  // Use this to log part of a larger string without copying it first.
+  static void Log(const LineView& line) {
+    if (GetCurrent()) {
+      GetCurrent()->LogLine(line);
+    }
+  }
 
   // Allows callers to manually cross threads.
   using ThreadCapture<LogText>::ThreadBridge;
@@ -42,7 +67,8 @@ class LogText : public ThreadCapture<LogText> {
   LogText() = default;
   virtual ~LogText() = default;
 
-  virtual void LogLine(std::string line) = 0;
+  // line is only valid until this returns.
+  virtual void LogLine(const LineView& line) = 0;
 };
 
 // Captures text log entries, without automatic thread crossing.
@@ -50,14 +76,14 @@ class LogTextSingleThread : public LogText {
  public:
   LogTextSingleThread() : capture_to_(this) {}
 
-  const std::list<std::string>& GetLines() { return lines_; }
+  const LineList& GetLines() { return lines_; }
 
  private:
-  void LogLine(std::string line) override {
-    lines_.emplace_back(std::move(line));
+  void LogLine(const LineView& line) override {
+    lines_.Append(line.data(), line.size());
   }
 
-  std::list<std::string> lines_;
+  LineList lines_;
   const ScopedCapture capture_to_;
 };
 
@@ -66,13 +92,153 @@ class LogTextMultiThread : public LogText {
  public:
   LogTextMultiThread() : cross_and_capture_to_(this) {}
 
-  std::list<std::string> GetLines();
+  // Returns a copy of all lines captured since the last call to Drain. This
+  // blocks logging threads for as long as the copy takes.
+  LineList GetLines();
+
+  // Removes and returns all lines captured since the last call to Drain. The
+  // storage is swapped out, so this blocks logging threads for O(1) time
+  // regardless of how many lines have been captured.
+  LineList Drain();
+
+ private:
+  void LogLine(const LineView& line) override;
+
+  std::mutex data_lock_;
+  LineList lines_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Captures text log entries, with automatic thread crossing. Each thread
+// appends to its own buffer without locking, so threads that are logging
+// concurrently don't block each other. The buffers are merged when they are
+// read.
+class LogTextPerThread : public LogText {
+ public:
+  // If ordered is true, lines are timestamped and merged in the order they
+  // were logged. Otherwise, the lines from each thread are kept together, in
+  // the order that the threads first logged. If stamped is true, each line is
+  // prefixed with a LogStamp when it's read.
+  explicit LogTextPerThread(bool ordered = false, bool stamped = false);
+  ~LogTextPerThread();
+
+  // Returns a copy of all lines that haven't been drained.
+  LineList GetLines();
+
+  // Removes and returns all lines that haven't been drained.
+  LineList Drain();
+
+ private:
+  class ThreadLines;
+
+  void LogLine(const LineView& line) override;
+
+  LineList Merge(bool consume);
+
+  const bool ordered_;
+  const bool stamped_;
+  // Serializes readers. Writers never take this lock.
+  std::mutex read_lock_;
+  PerThread<ThreadLines> threads_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Captures the most recent text log entries in a fixed amount of memory, with
+// automatic thread crossing. All memory is allocated up front, and the oldest
+// lines are overwritten without allocating, which makes this suitable as a
+// flight recorder that stays in scope for the lifetime of the process.
+class LogTextRing : public LogText {
+ public:
+  // Keeps at most max_lines lines, using at most max_bytes for their text.
+  // Lines longer than max_bytes are truncated.
+  LogTextRing(std::size_t max_lines, std::size_t max_bytes);
+
+  // Returns a consistent snapshot of the retained lines, oldest first.
+  LineList GetLines();
+
+  // Returns the number of lines that have been overwritten so far.
+  std::uint64_t GetOverwritten();
+
+ private:
+  struct Entry {
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  void LogLine(const LineView& line) override;
+
+  // Requires that data_lock_ is held.
+  void DropOldest();
+
+  const std::size_t max_lines_;
+  const std::size_t max_bytes_;
+  std::mutex data_lock_;
+  const std::unique_ptr<Entry[]> entries_;
+  const std::unique_ptr<char[]> text_;
+  std::size_t first_entry_ = 0;
+  std::size_t entry_count_ = 0;
+  std::size_t first_byte_ = 0;
+  std::size_t byte_count_ = 0;
+  std::uint64_t overwritten_ = 0;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Captures text log entries in compressed form, with automatic thread
+// crossing. Lines are appended to an uncompressed chunk; once the chunk is
+// full, it is compressed with LzCompress by a background thread, so logging
+// threads never wait for compression. Chunks are decompressed when read. Use
+// this to keep a long history of lines with much less memory.
+class LogTextCompressed : public LogText {
+ public:
+  explicit LogTextCompressed(std::size_t chunk_size = 1 << 16);
+  ~LogTextCompressed();
+
+  // Returns a copy of all lines captured so far. This blocks logging threads
+  // while the chunks are decompressed.
+  LineList GetLines();
+
+  // Returns the number of bytes currently used to store the lines.
+  std::size_t GetStoredBytes();
 
  private:
-  void LogLine(std::string line) override;
+  struct Chunk {
+    // Each line is stored as a uint32 size followed by the text.
+    std::string data;
+    bool compressed = false;
+  };
+
+  void LogLine(const LineView& line) override;
 
+  void CompressorThread();
+
+  const std::size_t chunk_size_;
   std::mutex data_lock_;
-  std::list<std::string> lines_;
+  std::condition_variable compressor_wait_;
+  bool terminated_ = false;
+  std::string open_chunk_;
+  // Only the compressor thread modifies a chunk once it's added here, and only
+  // while holding data_lock_.
+  std::list<Chunk> chunks_;
+  // The first chunk that hasn't been processed by the compressor thread.
+  std::list<Chunk>::iterator next_pending_ = chunks_.end();
+  std::thread compressor_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Writes text log entries to a MappedLogFile, with automatic thread crossing.
+// Logging threads never make a syscall unless a segment fills up. file is not
+// owned, so it can be shared by multiple captures, and must outlive this.
+class LogTextMappedFile : public LogText {
+ public:
+  explicit LogTextMappedFile(MappedLogFile* file)
+      : file_(file), cross_and_capture_to_(this) {}
+
+ private:
+  void LogLine(const LineView& line) override {
+    file_->AppendLine(line.data(), line.size());
+  }
+
+  MappedLogFile* const file_;
   const AutoThreadCrosser cross_and_capture_to_;
 };
 
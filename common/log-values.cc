@@ -16,6 +16,9 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <algorithm>
+#include <atomic>
+
 #include "log-values.h"
 
 namespace capture_thread {
@@ -28,7 +31,7 @@ void LogValues::Count(int count) {
   }
 }
 
-std::list<int> LogValuesMultiThread::GetCounts() {
+ChunkedList<int> LogValuesMultiThread::GetCounts() {
   std::lock_guard<std::mutex> lock(data_lock_);
   return counts_;
 }
@@ -38,5 +41,72 @@ void LogValuesMultiThread::LogCount(int count) {
   counts_.emplace_back(count);
 }
 
+namespace {
+
+int BucketFor(int value) {
+  // The number of significant bits in value.
+  int bucket = 0;
+  for (unsigned int remaining = value > 0 ? value : 0; remaining > 0;
+       remaining >>= 1) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+}  // namespace
+
+// Only the owning thread writes to a shard, so updates don't need atomic
+// read-modify-write operations; the atomics just make the values safe to read
+// from other threads.
+class LogValuesAggregate::Shard {
+ public:
+  // Must only be called by the owning thread.
+  void Add(int value) {
+    Increment(&count_, 1);
+    Increment(&sum_, value);
+    if (value < min_.load(std::memory_order_relaxed)) {
+      min_.store(value, std::memory_order_relaxed);
+    }
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+    Increment(&histogram_[BucketFor(value)], 1);
+  }
+
+  void AddTo(Summary* summary) const {
+    summary->count += count_.load(std::memory_order_relaxed);
+    summary->sum += sum_.load(std::memory_order_relaxed);
+    summary->min = std::min(summary->min, min_.load(std::memory_order_relaxed));
+    summary->max = std::max(summary->max, max_.load(std::memory_order_relaxed));
+    for (int i = 0; i < kBuckets; ++i) {
+      summary->histogram[i] += histogram_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static void Increment(std::atomic<std::int64_t>* value, std::int64_t amount) {
+    value->store(value->load(std::memory_order_relaxed) + amount,
+                 std::memory_order_relaxed);
+  }
+
+  std::atomic<std::int64_t> count_{0};
+  std::atomic<std::int64_t> sum_{0};
+  std::atomic<int> min_{std::numeric_limits<int>::max()};
+  std::atomic<int> max_{std::numeric_limits<int>::min()};
+  std::array<std::atomic<std::int64_t>, kBuckets> histogram_{};
+};
+
+LogValuesAggregate::LogValuesAggregate() : cross_and_capture_to_(this) {}
+
+LogValuesAggregate::~LogValuesAggregate() = default;
+
+LogValuesAggregate::Summary LogValuesAggregate::GetSummary() {
+  Summary summary;
+  shards_.ForEach([&summary](const Shard& shard) { shard.AddTo(&summary); });
+  return summary;
+}
+
+void LogValuesAggregate::LogCount(int count) { shards_.Local().Add(count); }
+
 }  // namespace testing
 }  // namespace capture_thread
@@ -19,9 +19,13 @@ limitations under the License.
 #ifndef LOG_VALUES_H_
 #define LOG_VALUES_H_
 
-#include <list>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <mutex>
 
+#include "chunked-storage.h"
+#include "per-thread.h"
 #include "thread-capture.h"
 #include "thread-crosser.h"
 
@@ -45,12 +49,12 @@ class LogValuesSingleThread : public LogValues {
  public:
   LogValuesSingleThread() : capture_to_(this) {}
 
-  const std::list<int>& GetCounts() { return counts_; }
+  const ChunkedList<int>& GetCounts() { return counts_; }
 
  private:
   void LogCount(int count) { counts_.emplace_back(count); }
 
-  std::list<int> counts_;
+  ChunkedList<int> counts_;
   const ScopedCapture capture_to_;
 };
 
@@ -59,13 +63,47 @@ class LogValuesMultiThread : public LogValues {
  public:
   LogValuesMultiThread() : cross_and_capture_to_(this) {}
 
-  std::list<int> GetCounts();
+  ChunkedList<int> GetCounts();
 
  private:
   void LogCount(int count);
 
   std::mutex data_lock_;
-  std::list<int> counts_;
+  ChunkedList<int> counts_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Aggregates numerical log entries, with automatic thread crossing. Only
+// summary statistics are kept, so memory use doesn't depend on the number of
+// entries. Each thread updates its own shard without locking; the shards are
+// combined when they are read.
+class LogValuesAggregate : public LogValues {
+ public:
+  // Bucket 0 counts values <= 0, and bucket i > 0 counts values in
+  // [2^(i-1), 2^i).
+  static constexpr int kBuckets = std::numeric_limits<int>::digits + 1;
+
+  struct Summary {
+    std::int64_t count = 0;
+    std::int64_t sum = 0;
+    int min = std::numeric_limits<int>::max();
+    int max = std::numeric_limits<int>::min();
+    std::array<std::int64_t, kBuckets> histogram{};
+  };
+
+  LogValuesAggregate();
+  ~LogValuesAggregate();
+
+  // Combines the shards from all threads. If other threads are still logging,
+  // the fields might not reflect exactly the same set of entries.
+  Summary GetSummary();
+
+ private:
+  class Shard;
+
+  void LogCount(int count) override;
+
+  PerThread<Shard> shards_;
   const AutoThreadCrosser cross_and_capture_to_;
 };
 
@@ -0,0 +1,161 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "lz-codec.h"
+
+namespace capture_thread {
+namespace testing {
+
+namespace {
+
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+std::uint32_t Read32(const char* data) {
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof value);
+  return value;
+}
+
+std::uint32_t Hash(std::uint32_t value) {
+  return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes the remainder of a length that didn't fit in its 4-bit nibble.
+void AppendLengthExtension(std::size_t length, std::string* output) {
+  for (length -= 15; length >= 255; length -= 255) {
+    output->push_back(static_cast<char>(255));
+  }
+  output->push_back(static_cast<char>(length));
+}
+
+void AppendSequence(const char* literals, std::size_t literal_length,
+                    std::size_t offset, std::size_t match_length,
+                    std::string* output) {
+  const std::size_t match_code =
+      match_length > 0 ? match_length - kMinMatch : 0;
+  const int literal_nibble = literal_length < 15 ? literal_length : 15;
+  const int match_nibble = match_code < 15 ? match_code : 15;
+  output->push_back(static_cast<char>((literal_nibble << 4) | match_nibble));
+  if (literal_nibble == 15) {
+    AppendLengthExtension(literal_length, output);
+  }
+  output->append(literals, literal_length);
+  if (match_length > 0) {
+    output->push_back(static_cast<char>(offset & 0xff));
+    output->push_back(static_cast<char>(offset >> 8));
+    if (match_nibble == 15) {
+      AppendLengthExtension(match_code, output);
+    }
+  }
+}
+
+// Reads the remainder of a length whose nibble was 15.
+bool ReadLengthExtension(const unsigned char** position,
+                         const unsigned char* end, std::size_t* length) {
+  unsigned char next;
+  do {
+    if (*position == end) {
+      return false;
+    }
+    next = *(*position)++;
+    *length += next;
+  } while (next == 255);
+  return true;
+}
+
+}  // namespace
+
+void LzCompress(const char* data, std::size_t size, std::string* output) {
+  std::vector<std::size_t> table(1 << kHashBits, SIZE_MAX);
+  std::size_t anchor = 0;
+  std::size_t position = 0;
+  while (position + kMinMatch <= size) {
+    const std::uint32_t value = Read32(data + position);
+    std::size_t& entry = table[Hash(value)];
+    const std::size_t candidate = entry;
+    entry = position;
+    if (candidate == SIZE_MAX || position - candidate > kMaxOffset ||
+        Read32(data + candidate) != value) {
+      ++position;
+      continue;
+    }
+    std::size_t length = kMinMatch;
+    while (position + length < size &&
+           data[candidate + length] == data[position + length]) {
+      ++length;
+    }
+    AppendSequence(data + anchor, position - anchor, position - candidate,
+                   length, output);
+    position += length;
+    anchor = position;
+  }
+  AppendSequence(data + anchor, size - anchor, 0, 0, output);
+}
+
+bool LzDecompress(const char* data, std::size_t size, std::string* output) {
+  const std::size_t start = output->size();
+  const unsigned char* position = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* const end = position + size;
+  while (position != end) {
+    const unsigned char token = *position++;
+    std::size_t literal_length = token >> 4;
+    if (literal_length == 15 &&
+        !ReadLengthExtension(&position, end, &literal_length)) {
+      return false;
+    }
+    if (static_cast<std::size_t>(end - position) < literal_length) {
+      return false;
+    }
+    output->append(reinterpret_cast<const char*>(position), literal_length);
+    position += literal_length;
+    if (position == end) {
+      // The final sequence only has literals.
+      return true;
+    }
+    if (end - position < 2) {
+      return false;
+    }
+    const std::size_t offset = position[0] | (position[1] << 8);
+    position += 2;
+    std::size_t match_length = token & 0x0f;
+    if (match_length == 15 &&
+        !ReadLengthExtension(&position, end, &match_length)) {
+      return false;
+    }
+    match_length += kMinMatch;
+    if (offset == 0 || offset > output->size() - start) {
+      return false;
+    }
+    // Byte-by-byte, since the match can overlap the data it produces.
+    std::size_t source = output->size() - offset;
+    for (std::size_t i = 0; i < match_length; ++i) {
+      output->push_back((*output)[source + i]);
+    }
+  }
+  // Even empty input has a final sequence.
+  return false;
+}
+
+}  // namespace testing
+}  // namespace capture_thread
@@ -0,0 +1,48 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef LZ_CODEC_H_
+#define LZ_CODEC_H_
+
+#include <cstddef>
+#include <string>
+
+namespace capture_thread {
+namespace testing {
+
+// Minimal LZ77-style codec, similar to the LZ4 block format. It favors speed
+// over compression ratio, which suits repetitive text such as log lines.
+//
+// The compressed data is a sequence of (literals, match) pairs. Each pair
+// starts with a token byte holding the literal length (high 4 bits) and the
+// match length minus 4 (low 4 bits); a nibble of 15 is extended with
+// additional bytes, each added to the length, until one is less than 255. The
+// literals follow, then a 2-byte little-endian offset back into the output.
+// The final pair only has literals.
+
+// Appends the compressed form of data to output.
+void LzCompress(const char* data, std::size_t size, std::string* output);
+
+// Appends the decompressed form of data to output. Returns false if data is
+// malformed, in which case output might contain partial results.
+bool LzDecompress(const char* data, std::size_t size, std::string* output);
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // LZ_CODEC_H_
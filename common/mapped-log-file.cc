@@ -0,0 +1,200 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+#include "mapped-log-file.h"
+
+namespace capture_thread {
+namespace testing {
+
+class MappedLogFile::Segment {
+ public:
+  // Returns nullptr if the file can't be created, allocated, or mapped.
+  static std::unique_ptr<Segment> Create(const std::string& path,
+                                         std::size_t capacity) {
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return nullptr;
+    }
+    // Allocates the blocks up front, rather than just setting the size with
+    // ftruncate. Writing to an unallocated page of a MAP_SHARED mapping raises
+    // SIGBUS if the disk is full, which would kill the process.
+    if (posix_fallocate(fd, 0, capacity) != 0) {
+      close(fd);
+      unlink(path.c_str());
+      return nullptr;
+    }
+    void* const data =
+        mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      unlink(path.c_str());
+      return nullptr;
+    }
+    return std::unique_ptr<Segment>(
+        new Segment(fd, static_cast<char*>(data), capacity));
+  }
+
+  // Requires that no writers are using the segment.
+  ~Segment() {
+    if (!released_.exchange(true)) {
+      Release();
+    }
+  }
+
+  // Returns false if the segment doesn't have room for size bytes. Once that
+  // happens, the segment won't accept any more data.
+  bool Write(const char* data, std::size_t size, char terminator) {
+    const std::size_t offset =
+        reserved_.fetch_add(size + 1, std::memory_order_relaxed);
+    if (offset + size + 1 > capacity_) {
+      // The first failed reservation marks the end of the data. Every later
+      // reservation also fails, so only successful writers touch data_.
+      std::size_t end = end_.load();
+      while (offset < end && !end_.compare_exchange_weak(end, offset)) {
+      }
+      MaybeRelease();
+      return false;
+    }
+    std::memcpy(data_ + offset, data, size);
+    data_[offset + size] = terminator;
+    committed_.fetch_add(size + 1);
+    MaybeRelease();
+    return true;
+  }
+
+  void Sync() {
+    std::lock_guard<std::mutex> lock(release_lock_);
+    if (mapped_) {
+      msync(data_, Used(), MS_SYNC);
+    }
+  }
+
+ private:
+  Segment(int fd, char* data, std::size_t capacity)
+      : fd_(fd), data_(data), capacity_(capacity), end_(capacity) {}
+
+  std::size_t Used() const {
+    return std::min(reserved_.load(std::memory_order_relaxed),
+                    end_.load(std::memory_order_relaxed));
+  }
+
+  // Releases the mapping once the segment is full and every successful
+  // reservation has been copied, i.e., committed_ == end_. The writer that
+  // completes either side of that is guaranteed to see the other, since both
+  // counters use sequentially-consistent operations.
+  void MaybeRelease() {
+    if (committed_.load() == end_.load() && !released_.exchange(true)) {
+      Release();
+    }
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> lock(release_lock_);
+    munmap(data_, capacity_);
+    mapped_ = false;
+    // Removes the unused space. Failing is harmless, since readers need to
+    // ignore NUL padding anyway.
+    const int result = ftruncate(fd_, Used());
+    (void)result;
+    close(fd_);
+  }
+
+  const int fd_;
+  char* const data_;
+  const std::size_t capacity_;
+  // Can exceed capacity_ due to failed reservations.
+  std::atomic<std::size_t> reserved_{0};
+  std::atomic<std::size_t> end_;
+  // Bytes that have been copied into place.
+  std::atomic<std::size_t> committed_{0};
+  std::atomic<bool> released_{false};
+  // Keeps Sync from using the mapping while it's being released.
+  std::mutex release_lock_;
+  bool mapped_ = true;
+};
+
+MappedLogFile::MappedLogFile(std::string prefix, std::size_t segment_size)
+    : prefix_(std::move(prefix)), segment_size_(segment_size) {
+  assert(segment_size_ > 0);
+  Roll(nullptr);
+}
+
+MappedLogFile::~MappedLogFile() = default;
+
+bool MappedLogFile::AppendLine(const char* data, std::size_t size) {
+  if (size > 0 && data[size - 1] == '\n') {
+    --size;
+  }
+  // Leaves room for the newline.
+  size = std::min(size, segment_size_ - 1);
+  Segment* segment = current_.load(std::memory_order_acquire);
+  while (true) {
+    if (segment && segment->Write(data, size, '\n')) {
+      return true;
+    }
+    segment = Roll(segment);
+    if (!segment) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+}
+
+void MappedLogFile::Sync() {
+  Segment* const segment = current_.load(std::memory_order_acquire);
+  if (segment) {
+    segment->Sync();
+  }
+}
+
+std::uint64_t MappedLogFile::GetDropped() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+std::string MappedLogFile::SegmentPath(int index) const {
+  return prefix_ + "." + std::to_string(index);
+}
+
+MappedLogFile::Segment* MappedLogFile::Roll(Segment* full) {
+  std::lock_guard<std::mutex> lock(roll_lock_);
+  Segment* const current = current_.load(std::memory_order_relaxed);
+  if (current != full) {
+    return current;
+  }
+  std::unique_ptr<Segment> created =
+      Segment::Create(SegmentPath(next_index_), segment_size_);
+  if (!created) {
+    return nullptr;
+  }
+  ++next_index_;
+  segments_.push_back(std::move(created));
+  current_.store(segments_.back().get(), std::memory_order_release);
+  return segments_.back().get();
+}
+
+}  // namespace testing
+}  // namespace capture_thread
@@ -0,0 +1,100 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef MAPPED_LOG_FILE_H_
+#define MAPPED_LOG_FILE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace capture_thread {
+namespace testing {
+
+// Append-only log file that is written through a memory mapping rather than
+// with a syscall per line. The file is split into segments named "<prefix>.0",
+// "<prefix>.1", etc. Writers reserve space in the current segment with an
+// atomic fetch-add and then copy the line into place, so they only block each
+// other when a segment fills up and the next one is created.
+//
+// The disk space for each segment is allocated with posix_fallocate when the
+// segment is created, so a full disk can't cause SIGBUS while writing through
+// the mapping. If a segment can't be allocated, lines are dropped (and counted
+// by GetDropped) until a later attempt to create it succeeds.
+//
+// Written lines are in the page cache as soon as the copy completes, so they
+// survive a crash of the process (but not of the system) without any flushing.
+// Use Sync to also write them to disk. Segments are unmapped and truncated to
+// the size of their contents once they are full and all writers are done with
+// them; a segment that was in use during a crash instead ends with NUL padding,
+// which readers should ignore.
+//
+// This class is thread-safe.
+class MappedLogFile {
+ public:
+  // segment_size must be positive, and should be a multiple of the page size.
+  MappedLogFile(std::string prefix, std::size_t segment_size);
+  ~MappedLogFile();
+
+  // Appends the line, followed by a newline if it doesn't already end in one.
+  // Lines longer than a segment are truncated. Returns false if the line was
+  // dropped because a segment couldn't be created.
+  bool AppendLine(const char* data, std::size_t size);
+
+  // Blocks until the contents of the current segment are written to disk.
+  void Sync();
+
+  // Returns the number of lines dropped so far.
+  std::uint64_t GetDropped() const;
+
+  // Returns the path of the segment with the given index.
+  std::string SegmentPath(int index) const;
+
+ private:
+  MappedLogFile(const MappedLogFile&) = delete;
+  MappedLogFile(MappedLogFile&&) = delete;
+  MappedLogFile& operator=(const MappedLogFile&) = delete;
+  MappedLogFile& operator=(MappedLogFile&&) = delete;
+
+  class Segment;
+
+  // Replaces full with a new segment, unless another thread already has.
+  // Returns the new current segment, or nullptr if it couldn't be created.
+  Segment* Roll(Segment* full);
+
+  const std::string prefix_;
+  const std::size_t segment_size_;
+  std::mutex roll_lock_;
+  int next_index_ = 0;
+  // Every segment created so far. A full segment's mapping is released by the
+  // last writer to finish copying into it, but the (small) Segment object is
+  // kept until destruction, since other writers might still be about to find
+  // out that it's full.
+  std::vector<std::unique_ptr<Segment>> segments_;
+  std::atomic<Segment*> current_{nullptr};
+  std::atomic<std::uint64_t> dropped_{0};
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // MAPPED_LOG_FILE_H_
@@ -0,0 +1,111 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef PER_THREAD_H_
+#define PER_THREAD_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace capture_thread {
+namespace testing {
+
+// Lazily creates one instance of Type for each thread that accesses it. Only
+// the first access from each thread takes a lock; after that, the instance is
+// found via a small thread-local cache. Instances are owned by the PerThread,
+// rather than by the threads, so they can still be read after the threads that
+// created them have exited.
+//
+// NOTE: Type is responsible for synchronizing reads by other threads (e.g., via
+// ForEach) with writes by the thread that owns the instance.
+template <class Type>
+class PerThread {
+ public:
+  PerThread() : id_(NextId()) {}
+
+  // Returns the instance for the calling thread, creating it if necessary.
+  Type& Local() {
+    CacheEntry& entry = cache_[id_ % kCacheSize];
+    if (entry.owner != id_) {
+      entry.value = Register();
+      entry.owner = id_;
+    }
+    return *entry.value;
+  }
+
+  // Calls visit for each instance, in the order they were created.
+  template <class Visit>
+  void ForEach(Visit visit) {
+    std::lock_guard<std::mutex> lock(instances_lock_);
+    for (const auto& instance : instances_) {
+      visit(*instance);
+    }
+  }
+
+ private:
+  PerThread(const PerThread&) = delete;
+  PerThread(PerThread&&) = delete;
+  PerThread& operator=(const PerThread&) = delete;
+  PerThread& operator=(PerThread&&) = delete;
+
+  // Direct-mapped by owner ID, so that alternating between a few PerThread
+  // doesn't fall back to locking. IDs are never reused, so a stale entry can't
+  // match a different PerThread at the same address.
+  static constexpr int kCacheSize = 8;
+
+  struct CacheEntry {
+    std::uint64_t owner;
+    Type* value;
+  };
+
+  static std::uint64_t NextId() {
+    static std::atomic<std::uint64_t> next_id(1);
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Type* Register() {
+    std::lock_guard<std::mutex> lock(instances_lock_);
+    Type*& instance = by_thread_[std::this_thread::get_id()];
+    if (!instance) {
+      instances_.emplace_back(new Type);
+      instance = instances_.back().get();
+    }
+    return instance;
+  }
+
+  static thread_local CacheEntry cache_[kCacheSize];
+
+  const std::uint64_t id_;
+  std::mutex instances_lock_;
+  std::vector<std::unique_ptr<Type>> instances_;
+  std::unordered_map<std::thread::id, Type*> by_thread_;
+};
+
+template <class Type>
+thread_local typename PerThread<Type>::CacheEntry
+    PerThread<Type>::cache_[PerThread<Type>::kCacheSize] = {};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // PER_THREAD_H_
@@ -0,0 +1,97 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <cassert>
+
+#include "task-graph.h"
+#include "thread-crosser.h"
+
+namespace capture_thread {
+namespace testing {
+
+TaskGraph::TaskId TaskGraph::AddTask(std::function<void()> task,
+                                     const std::vector<TaskId>& dependencies) {
+  const TaskId id = tasks_.size();
+  std::unique_ptr<Task> new_task(new Task);
+  new_task->call = ThreadCrosser::WrapCall(std::move(task));
+  new_task->dependencies = dependencies.size();
+  new_task->remaining = 0;
+  for (const TaskId dependency : dependencies) {
+    assert(dependency >= 0 && dependency < id);
+    tasks_[dependency]->successors.push_back(id);
+  }
+  tasks_.emplace_back(std::move(new_task));
+  return id;
+}
+
+void TaskGraph::Execute(CallbackQueue* queue) {
+  assert(queue);
+  if (tasks_.empty()) {
+    return;
+  }
+  for (const auto& task : tasks_) {
+    task->remaining.store(task->dependencies, std::memory_order_relaxed);
+  }
+  unfinished_.store(tasks_.size(), std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(finished_lock_);
+    finished_ = false;
+  }
+  for (TaskId id = 0; id < static_cast<TaskId>(tasks_.size()); ++id) {
+    if (tasks_[id]->dependencies == 0) {
+      queue->Push(std::bind(&TaskGraph::RunTask, this, id, queue));
+    }
+  }
+  std::unique_lock<std::mutex> lock(finished_lock_);
+  while (!finished_) {
+    finished_wait_.wait(lock);
+  }
+}
+
+void TaskGraph::RunTask(TaskId id, CallbackQueue* queue) {
+  while (id >= 0) {
+    Task& task = *tasks_[id];
+    if (task.call) {
+      task.call();
+    }
+    // The first successor that becomes runnable is executed directly by this
+    // thread, rather than making a round trip through the queue.
+    TaskId next = -1;
+    for (const TaskId successor : task.successors) {
+      if (tasks_[successor]->remaining.fetch_sub(
+              1, std::memory_order_acq_rel) == 1) {
+        if (next < 0) {
+          next = successor;
+        } else {
+          queue->Push(std::bind(&TaskGraph::RunTask, this, successor, queue));
+        }
+      }
+    }
+    if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // Execute can't return until finished_lock_ is released, so this is the
+      // last access to the graph.
+      std::lock_guard<std::mutex> lock(finished_lock_);
+      finished_ = true;
+      finished_wait_.notify_all();
+    }
+    id = next;
+  }
+}
+
+}  // namespace testing
+}  // namespace capture_thread
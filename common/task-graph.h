@@ -0,0 +1,91 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef TASK_GRAPH_H_
+#define TASK_GRAPH_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "callback-queue.h"
+
+namespace capture_thread {
+namespace testing {
+
+// Executes a DAG of tasks using a CallbackQueue. Each task becomes runnable as
+// soon as all of the tasks it depends on have finished. Readiness is tracked
+// with an atomic counter per task, so finishing a task never blocks the other
+// threads executing the graph.
+//
+// Tasks are wrapped with ThreadCrosser::WrapCall when they are added, so they
+// execute in the instrumentation context in which the graph was built.
+class TaskGraph {
+ public:
+  using TaskId = int;
+
+  TaskGraph() = default;
+
+  // Adds a task that becomes runnable once all of dependencies have finished.
+  // Every dependency must have been returned by a previous call to AddTask,
+  // which ensures that the graph has no cycles.
+  TaskId AddTask(std::function<void()> task,
+                 const std::vector<TaskId>& dependencies = {});
+
+  // Executes all tasks using the queue, and blocks until they have finished.
+  // Must not be called concurrently, or while tasks are being added. Can be
+  // called more than once to re-execute the graph.
+  //
+  // NOTE: Must not be called from a thread that executes callbacks from queue
+  // (e.g., from within another task). The calling thread blocks without
+  // executing any tasks, so if it's one of the queue's workers, the graph can
+  // deadlock waiting for tasks that only that worker would have executed.
+  void Execute(CallbackQueue* queue);
+
+ private:
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph(TaskGraph&&) = delete;
+  TaskGraph& operator=(const TaskGraph&) = delete;
+  TaskGraph& operator=(TaskGraph&&) = delete;
+
+  struct Task {
+    std::function<void()> call;
+    std::vector<TaskId> successors;
+    int dependencies;
+    std::atomic<int> remaining;
+  };
+
+  void RunTask(TaskId id, CallbackQueue* queue);
+
+  std::vector<std::unique_ptr<Task>> tasks_;
+  std::atomic<int> unfinished_{0};
+  std::mutex finished_lock_;
+  std::condition_variable finished_wait_;
+  // Set by the thread that finishes the last task, while it holds
+  // finished_lock_. Execute waits for this rather than for unfinished_, since
+  // the graph might be destroyed as soon as Execute returns.
+  bool finished_ = false;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // TASK_GRAPH_H_
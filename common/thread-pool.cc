@@ -0,0 +1,221 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#include "thread-crosser.h"
+#include "thread-pool.h"
+
+namespace capture_thread {
+namespace testing {
+
+ThreadPool::ThreadPool(int min_threads, int max_threads,
+                       Clock::duration max_queue_wait,
+                       Clock::duration idle_timeout,
+                       WorkerScope worker_scope)
+    : min_threads_(min_threads),
+      max_threads_(max_threads),
+      max_queue_wait_(max_queue_wait),
+      idle_timeout_(idle_timeout),
+      worker_scope_(std::move(worker_scope)),
+      worker_(ThreadCrosser::WrapFunction(std::function<void(int)>(
+          std::bind(&ThreadPool::RunWorker, this, std::placeholders::_1)))),
+      monitor_(&ThreadPool::MonitorThread, this) {
+  assert(min_threads_ >= 0);
+  assert(max_threads_ > 0 && max_threads_ >= min_threads_);
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  for (int i = 0; i < min_threads_; ++i) {
+    StartThread();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  std::map<int, std::thread> threads;
+  std::list<std::thread> retired;
+  {
+    std::lock_guard<std::mutex> lock(pool_lock_);
+    terminated_ = true;
+    pool_wait_.notify_all();
+    monitor_wait_.notify_all();
+    for (std::condition_variable* worker : idle_workers_) {
+      worker->notify_all();
+    }
+    idle_workers_.clear();
+    threads.swap(threads_);
+    retired.swap(retired_);
+  }
+  // The monitor can't start new workers once terminated_ is set.
+  monitor_.join();
+  for (auto& thread : threads) {
+    thread.second.join();
+  }
+  for (auto& thread : retired) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Push(std::function<void()> callback) {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  if (!terminated_) {
+    queue_.push(Queued{std::move(callback), Clock::now()});
+    MaybeGrow();
+    WakeIdleWorker();
+    monitor_wait_.notify_all();
+  }
+}
+
+void ThreadPool::WaitUntilEmpty() {
+  std::unique_lock<std::mutex> lock(pool_lock_);
+  while (!terminated_ && (!queue_.empty() || pending_ > 0)) {
+    pool_wait_.wait(lock);
+  }
+}
+
+int ThreadPool::ThreadCount() {
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  return threads_.size();
+}
+
+void ThreadPool::MaybeGrow() {
+  // Checked when a callback is pushed or taken by a worker, so that the
+  // monitor thread only needs to handle callbacks that wait with all workers
+  // busy.
+  if (queue_.empty() || static_cast<int>(threads_.size()) >= max_threads_) {
+    return;
+  }
+  if (threads_.empty() ||
+      (idle_ == 0 &&
+       Clock::now() - queue_.front().queued_at >= max_queue_wait_)) {
+    StartThread();
+  }
+}
+
+void ThreadPool::StartThread() {
+  const int id = next_id_++;
+  // New workers count as idle until they take a callback, so that a burst of
+  // callbacks doesn't start more workers than necessary.
+  ++idle_;
+  threads_.emplace(id, std::thread(worker_, id));
+}
+
+void ThreadPool::WakeIdleWorker() {
+  // The most recently idle worker is woken, so that when demand drops, the
+  // same workers keep getting callbacks and the rest reach idle_timeout.
+  if (!idle_workers_.empty()) {
+    idle_workers_.back()->notify_all();
+    idle_workers_.pop_back();
+  }
+}
+
+void ThreadPool::RunWorker(int id) {
+  if (worker_scope_) {
+    worker_scope_(id, [this, id] { WorkerThread(id); });
+  } else {
+    WorkerThread(id);
+  }
+}
+
+void ThreadPool::WorkerThread(int id) {
+  std::condition_variable wake;
+  std::unique_lock<std::mutex> lock(pool_lock_);
+  while (true) {
+    // Being woken doesn't reset this, so a worker that is repeatedly woken but
+    // never gets a callback still retires.
+    const Clock::time_point idle_since = Clock::now();
+    while (!terminated_ && queue_.empty()) {
+      idle_workers_.push_back(&wake);
+      wake.wait_until(lock, idle_since + idle_timeout_);
+      // Still present unless this worker was woken by WakeIdleWorker.
+      const auto position =
+          std::find(idle_workers_.begin(), idle_workers_.end(), &wake);
+      if (position != idle_workers_.end()) {
+        idle_workers_.erase(position);
+      }
+      if (!terminated_ && queue_.empty() &&
+          Clock::now() - idle_since >= idle_timeout_ &&
+          static_cast<int>(threads_.size()) > min_threads_) {
+        --idle_;
+        retired_.emplace_back(std::move(threads_[id]));
+        threads_.erase(id);
+        monitor_wait_.notify_all();
+        return;
+      }
+    }
+    if (terminated_) {
+      --idle_;
+      return;
+    }
+    auto callback = std::move(queue_.front().callback);
+    queue_.pop();
+    --idle_;
+    ++pending_;
+    if (!queue_.empty()) {
+      WakeIdleWorker();
+    }
+    MaybeGrow();
+    // The monitor might have been waiting for this worker to become busy.
+    monitor_wait_.notify_all();
+    lock.unlock();
+    if (callback) {
+      callback();
+    }
+    // Destroys the callback outside of the lock, since it might own arbitrary
+    // state.
+    callback = nullptr;
+    lock.lock();
+    --pending_;
+    ++idle_;
+    pool_wait_.notify_all();
+  }
+}
+
+void ThreadPool::MonitorThread() {
+  std::unique_lock<std::mutex> lock(pool_lock_);
+  while (!terminated_) {
+    if (!retired_.empty()) {
+      // Joined without the lock, since a WorkerScope can run arbitrary code,
+      // including code that uses the pool, after its worker retires.
+      std::list<std::thread> retired;
+      retired.swap(retired_);
+      lock.unlock();
+      for (auto& thread : retired) {
+        thread.join();
+      }
+      lock.lock();
+      continue;
+    }
+    if (queue_.empty() || idle_ > 0 ||
+        static_cast<int>(threads_.size()) >= max_threads_) {
+      // Waits for a change that could make a new worker necessary.
+      monitor_wait_.wait(lock);
+      continue;
+    }
+    const Clock::time_point deadline =
+        queue_.front().queued_at + max_queue_wait_;
+    if (Clock::now() >= deadline) {
+      MaybeGrow();
+    } else {
+      monitor_wait_.wait_until(lock, deadline);
+    }
+  }
+}
+
+}  // namespace testing
+}  // namespace capture_thread
@@ -0,0 +1,124 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace capture_thread {
+namespace testing {
+
+// Executes callbacks with a pool of worker threads that grows and shrinks with
+// demand. A new worker is started when the oldest queued callback has waited
+// longer than max_queue_wait and no worker is idle, which is checked whenever a
+// callback is pushed or taken by a worker, and by a monitor thread when the
+// oldest callback reaches max_queue_wait. Workers retire after being idle for
+// idle_timeout. Callbacks go to the most recently idle worker, so when demand
+// drops (but doesn't stop) the surplus workers stay idle and retire. The
+// number of workers stays within [min_threads, max_threads].
+//
+// Workers are started in the instrumentation context that was in scope when
+// the pool was constructed, regardless of which thread causes them to start.
+// Callbacks are *not* wrapped automatically; use ThreadCrosser::WrapCall when
+// pushing if they need the caller's context.
+class ThreadPool {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Called on each new worker thread with the worker's ID, e.g., to add
+  // per-worker instrumentation. Must call run exactly once; the worker exits
+  // when both run and the WorkerScope return.
+  using WorkerScope =
+      std::function<void(int id, const std::function<void()>& run)>;
+
+  ThreadPool(int min_threads, int max_threads,
+             Clock::duration max_queue_wait = std::chrono::milliseconds(10),
+             Clock::duration idle_timeout = std::chrono::seconds(10),
+             WorkerScope worker_scope = nullptr);
+
+  // Waits for executing callbacks to finish. Callbacks that have not started
+  // yet are dropped.
+  ~ThreadPool();
+
+  void Push(std::function<void()> callback);
+
+  void WaitUntilEmpty();
+
+  // Returns the current number of workers.
+  int ThreadCount();
+
+ private:
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  struct Queued {
+    std::function<void()> callback;
+    Clock::time_point queued_at;
+  };
+
+  // All of these require that pool_lock_ is held.
+  void MaybeGrow();
+  void StartThread();
+  void WakeIdleWorker();
+
+  void RunWorker(int id);
+  void WorkerThread(int id);
+  void MonitorThread();
+
+  const int min_threads_;
+  const int max_threads_;
+  const Clock::duration max_queue_wait_;
+  const Clock::duration idle_timeout_;
+  const WorkerScope worker_scope_;
+  // Wrapped once at construction, so that every worker starts in the context
+  // of the pool rather than that of the thread that triggered its creation.
+  const std::function<void(int)> worker_;
+  std::mutex pool_lock_;
+  // Only waited on by WaitUntilEmpty.
+  std::condition_variable pool_wait_;
+  // Idle workers waiting for a callback, in the order they became idle.
+  std::vector<std::condition_variable*> idle_workers_;
+  // Only waited on by the monitor thread.
+  std::condition_variable monitor_wait_;
+  bool terminated_ = false;
+  int idle_ = 0;
+  int pending_ = 0;
+  int next_id_ = 0;
+  std::queue<Queued> queue_;
+  std::map<int, std::thread> threads_;
+  // Threads can't join themselves, so retired workers are joined later by the
+  // monitor thread.
+  std::list<std::thread> retired_;
+  std::thread monitor_;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // THREAD_POOL_H_
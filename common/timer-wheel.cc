@@ -0,0 +1,242 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <cassert>
+#include <limits>
+
+#include "thread-crosser.h"
+#include "timer-wheel.h"
+
+namespace capture_thread {
+namespace testing {
+
+namespace {
+const std::uint64_t kNever = std::numeric_limits<std::uint64_t>::max();
+}  // namespace
+
+TimerWheel::TimerWheel(CallbackQueue* queue, Clock::duration resolution)
+    : queue_(queue),
+      resolution_(resolution),
+      start_(Clock::now()),
+      timer_thread_(std::bind(&TimerWheel::TimerThread, this)) {
+  assert(queue_);
+  assert(resolution_.count() > 0);
+}
+
+TimerWheel::~TimerWheel() {
+  {
+    std::lock_guard<std::mutex> lock(wheel_lock_);
+    terminated_ = true;
+    wheel_wait_.notify_all();
+  }
+  timer_thread_.join();
+}
+
+TimerWheel::TimerId TimerWheel::RunAfter(Clock::duration delay,
+                                         std::function<void()> callback) {
+  return RunAt(Clock::now() + delay, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::RunAt(Clock::time_point deadline,
+                                      std::function<void()> callback) {
+  // Wrapping is done here so that the callback executes in the context of the
+  // caller, rather than that of the thread that happens to execute it.
+  std::unique_ptr<Timer> timer(
+      new Timer{0, 0, ThreadCrosser::WrapCall(std::move(callback)), nullptr,
+                nullptr, nullptr});
+  std::lock_guard<std::mutex> lock(wheel_lock_);
+  if (timers_.empty()) {
+    // The timer thread doesn't track time while the wheel is empty.
+    const auto elapsed = (Clock::now() - start_) / resolution_;
+    if (elapsed > 0 && static_cast<std::uint64_t>(elapsed) > current_tick_) {
+      current_tick_ = elapsed;
+    }
+  }
+  const TimerId id = next_id_++;
+  timer->id = id;
+  // The current tick might have already been processed, so the earliest
+  // possible expiration is the next tick.
+  timer->expiration = TickFor(deadline);
+  if (timer->expiration <= current_tick_) {
+    timer->expiration = current_tick_ + 1;
+  }
+  Link(timer.get());
+  timers_.emplace(id, std::move(timer));
+  wheel_wait_.notify_all();
+  return id;
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+  std::unique_ptr<Timer> timer;
+  {
+    std::lock_guard<std::mutex> lock(wheel_lock_);
+    const auto position = timers_.find(id);
+    if (position == timers_.end()) {
+      return false;
+    }
+    Unlink(position->second.get());
+    // The callback is destroyed outside of the lock, since it might own
+    // arbitrary state.
+    timer = std::move(position->second);
+    timers_.erase(position);
+  }
+  return true;
+}
+
+std::uint64_t TimerWheel::TickFor(Clock::time_point time) const {
+  if (time <= start_) {
+    return 0;
+  }
+  // Rounds up so that timers never execute early.
+  const auto elapsed = time - start_;
+  return (elapsed.count() + resolution_.count() - 1) / resolution_.count();
+}
+
+void TimerWheel::Link(Timer* timer) {
+  assert(timer);
+  const std::uint64_t delta = timer->expiration > current_tick_
+                                  ? timer->expiration - current_tick_
+                                  : 0;
+  int level = 0;
+  std::uint64_t position = timer->expiration;
+  while (level < kLevels - 1 &&
+         delta >= (std::uint64_t(1) << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  if (delta >= (std::uint64_t(1) << (kSlotBits * kLevels))) {
+    // Too far in the future for the wheel. Park the timer in the farthest slot;
+    // it will be re-linked relative to the new time when that slot cascades.
+    position = current_tick_ + (std::uint64_t(1) << (kSlotBits * kLevels)) - 1;
+  }
+  Timer** const slot =
+      &slots_[level][(position >> (kSlotBits * level)) & (kSlots - 1)];
+  timer->slot = slot;
+  timer->previous = nullptr;
+  timer->next = *slot;
+  if (timer->next) {
+    timer->next->previous = timer;
+  }
+  *slot = timer;
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+  assert(timer && timer->slot);
+  if (timer->previous) {
+    timer->previous->next = timer->next;
+  } else {
+    *timer->slot = timer->next;
+  }
+  if (timer->next) {
+    timer->next->previous = timer->previous;
+  }
+  timer->previous = timer->next = nullptr;
+  timer->slot = nullptr;
+}
+
+void TimerWheel::AdvanceOneTick(std::list<std::function<void()>>* expired) {
+  assert(expired);
+  ++current_tick_;
+
+  // Higher levels cascade into lower levels whenever the lower levels wrap
+  // around. This must happen from the top down, so that timers cascading
+  // through multiple levels end up in the correct slot.
+  int top_level = 0;
+  while (top_level < kLevels - 1 &&
+         (current_tick_ &
+          ((std::uint64_t(1) << (kSlotBits * (top_level + 1))) - 1)) == 0) {
+    ++top_level;
+  }
+  for (int level = top_level; level > 0; --level) {
+    Timer** const slot =
+        &slots_[level][(current_tick_ >> (kSlotBits * level)) & (kSlots - 1)];
+    Timer* timer = *slot;
+    *slot = nullptr;
+    while (timer) {
+      Timer* const next = timer->next;
+      Link(timer);
+      timer = next;
+    }
+  }
+
+  Timer** const slot = &slots_[0][current_tick_ & (kSlots - 1)];
+  Timer* timer = *slot;
+  *slot = nullptr;
+  while (timer) {
+    Timer* const next = timer->next;
+    if (timer->expiration <= current_tick_) {
+      expired->emplace_back(std::move(timer->callback));
+      timers_.erase(timer->id);
+    } else {
+      Link(timer);
+    }
+    timer = next;
+  }
+}
+
+std::uint64_t TimerWheel::NextWakeTick() const {
+  if (timers_.empty()) {
+    return kNever;
+  }
+  // Nothing can happen between the next occupied slot in the lowest level and
+  // the next time the lowest level wraps around.
+  for (std::uint64_t tick = current_tick_ + 1;; ++tick) {
+    if (slots_[0][tick & (kSlots - 1)] || (tick & (kSlots - 1)) == 0) {
+      return tick;
+    }
+  }
+}
+
+void TimerWheel::TimerThread() {
+  std::unique_lock<std::mutex> lock(wheel_lock_);
+  while (!terminated_) {
+    const auto elapsed = (Clock::now() - start_) / resolution_;
+    const std::uint64_t now_tick = elapsed > 0 ? elapsed : 0;
+    std::list<std::function<void()>> expired;
+    while (current_tick_ < now_tick) {
+      // Skips ahead over ticks where nothing can happen.
+      const std::uint64_t next_tick = NextWakeTick();
+      if (next_tick > now_tick) {
+        current_tick_ = now_tick;
+        break;
+      }
+      current_tick_ = next_tick - 1;
+      AdvanceOneTick(&expired);
+    }
+    if (!expired.empty()) {
+      // The queue has its own lock, so this is done without blocking callers
+      // that are scheduling or cancelling timers.
+      lock.unlock();
+      for (auto& callback : expired) {
+        queue_->Push(std::move(callback));
+      }
+      expired.clear();
+      lock.lock();
+      continue;
+    }
+    const std::uint64_t wake_tick = NextWakeTick();
+    if (wake_tick == kNever) {
+      wheel_wait_.wait(lock);
+    } else {
+      wheel_wait_.wait_until(
+          lock, start_ + resolution_ * static_cast<Clock::rep>(wake_tick));
+    }
+  }
+}
+
+}  // namespace testing
+}  // namespace capture_thread
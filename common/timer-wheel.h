@@ -0,0 +1,124 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "callback-queue.h"
+
+namespace capture_thread {
+namespace testing {
+
+// Schedules callbacks to be pushed to a CallbackQueue after a delay. Timers are
+// kept in a hierarchical timing wheel, so scheduling and cancelling are O(1)
+// regardless of how many timers are pending. A single internal thread advances
+// the wheel; the callbacks themselves are executed by whatever threads are
+// servicing the queue.
+//
+// Callbacks are wrapped with ThreadCrosser::WrapCall when they are scheduled,
+// so they execute in the instrumentation context of the caller.
+//
+// NOTE: As with ThreadCrosser::WrapCall, the instrumentation in scope when a
+// timer is scheduled must not go out of scope before the timer either runs or
+// is cancelled.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = std::uint64_t;
+
+  // The queue must outlive the TimerWheel. resolution is the duration of a
+  // single tick of the wheel; deadlines are rounded up to the next tick.
+  explicit TimerWheel(
+      CallbackQueue* queue,
+      Clock::duration resolution = std::chrono::milliseconds(1));
+
+  // Pending timers are dropped without being executed.
+  ~TimerWheel();
+
+  // Schedules callback to be queued once delay has elapsed. Returns an ID that
+  // can be passed to Cancel.
+  TimerId RunAfter(Clock::duration delay, std::function<void()> callback);
+
+  // Schedules callback to be queued once deadline has passed. Returns an ID
+  // that can be passed to Cancel.
+  TimerId RunAt(Clock::time_point deadline, std::function<void()> callback);
+
+  // Cancels a pending timer. Returns false if the timer has already been
+  // queued, has already been cancelled, or never existed.
+  bool Cancel(TimerId id);
+
+ private:
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel(TimerWheel&&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+  TimerWheel& operator=(TimerWheel&&) = delete;
+
+  static constexpr int kLevels = 4;
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+
+  // Timers are stored in intrusive doubly-linked lists so that they can be
+  // removed from their slot in O(1).
+  struct Timer {
+    TimerId id;
+    std::uint64_t expiration;
+    std::function<void()> callback;
+    Timer* previous;
+    Timer* next;
+    Timer** slot;
+  };
+
+  std::uint64_t TickFor(Clock::time_point time) const;
+
+  // All of the following require that wheel_lock_ is held.
+  void Link(Timer* timer);
+  void Unlink(Timer* timer);
+  void AdvanceOneTick(std::list<std::function<void()>>* expired);
+  std::uint64_t NextWakeTick() const;
+
+  void TimerThread();
+
+  CallbackQueue* const queue_;
+  const Clock::duration resolution_;
+  const Clock::time_point start_;
+  std::mutex wheel_lock_;
+  std::condition_variable wheel_wait_;
+  bool terminated_ = false;
+  std::uint64_t current_tick_ = 0;
+  TimerId next_id_ = 1;
+  Timer* slots_[kLevels][kSlots] = {};
+  std::unordered_map<TimerId, std::unique_ptr<Timer>> timers_;
+  // Must be last so that the thread isn't started until everything else has
+  // been initialized.
+  std::thread timer_thread_;
+};
+
+}  // namespace testing
+}  // namespace capture_thread
+
+#endif  // TIMER_WHEEL_H_
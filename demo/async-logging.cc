@@ -0,0 +1,186 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <errno.h>
+
+#include "async-logging.h"
+
+namespace demo {
+
+namespace {
+
+// Keeps individual writes from getting so large that the pipe or terminal on
+// the other end stalls the writer for a long time.
+constexpr std::size_t kMaxBatchSize = 1 << 16;
+
+// Long enough for most lines, so that slots rarely need to grow.
+constexpr std::size_t kInitialSlotCapacity = 256;
+
+std::size_t RoundUpToPowerOf2(std::size_t size) {
+  std::size_t rounded = 1;
+  while (rounded < size) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+}  // namespace
+
+AsyncWriter::AsyncWriter(int fd, std::chrono::milliseconds flush_interval,
+                         std::size_t queue_size)
+    : fd_(fd),
+      flush_interval_(flush_interval),
+      queue_size_(RoundUpToPowerOf2(queue_size)),
+      slots_(new Slot[queue_size_]) {
+  for (std::size_t i = 0; i < queue_size_; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+    slots_[i].text.reserve(kInitialSlotCapacity);
+  }
+  // Started only once the slots are initialized.
+  writer_ = std::thread(&AsyncWriter::WriterThread, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+  {
+    std::lock_guard<std::mutex> lock(writer_lock_);
+    terminated_ = true;
+    writer_wait_.notify_all();
+  }
+  writer_.join();
+  // Picks up anything logged after the writer's last pass, including lines
+  // whose slots were claimed but not yet filled.
+  while (dequeue_position_ !=
+         enqueue_position_.load(std::memory_order_acquire)) {
+    WritePending();
+    std::this_thread::yield();
+  }
+}
+
+void AsyncWriter::Flush() {
+  std::unique_lock<std::mutex> lock(writer_lock_);
+  const int requested = ++flush_requested_;
+  writer_wait_.notify_all();
+  while (flushed_ < requested && !terminated_) {
+    flushed_wait_.wait(lock);
+  }
+}
+
+void AsyncWriter::Write(Logging::Severity severity,
+                        const std::shared_ptr<const std::string>& line) {
+  Write(capture_thread::testing::LineView(line->data(), line->size()));
+}
+
+void AsyncWriter::Write(capture_thread::testing::LineView line) {
+  // The writer thread isn't notified unless the queue is full, since it wakes
+  // up periodically anyway.
+  std::size_t position = enqueue_position_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[position & (queue_size_ - 1)];
+    const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (enqueue_position_.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed)) {
+        slot.text.assign(line.data(), line.size());
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return;
+      }
+    } else if (sequence < position) {
+      // The slot still holds a line from the previous lap, i.e., the queue is
+      // full.
+      Nudge();
+      std::this_thread::yield();
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    } else {
+      // Another producer claimed the slot first.
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void AsyncWriter::Nudge() {
+  std::lock_guard<std::mutex> lock(writer_lock_);
+  if (flushed_ == flush_requested_) {
+    ++flush_requested_;
+    writer_wait_.notify_all();
+  }
+}
+
+void AsyncWriter::WriterThread() {
+  std::unique_lock<std::mutex> lock(writer_lock_);
+  while (true) {
+    writer_wait_.wait_for(lock, flush_interval_, [this] {
+      return terminated_ || flushed_ < flush_requested_;
+    });
+    const int requested = flush_requested_;
+    const bool terminated = terminated_;
+    lock.unlock();
+    WritePending();
+    lock.lock();
+    flushed_ = requested;
+    flushed_wait_.notify_all();
+    if (terminated) {
+      break;
+    }
+  }
+}
+
+void AsyncWriter::WritePending() {
+  while (true) {
+    Slot& slot = slots_[dequeue_position_ & (queue_size_ - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) !=
+        dequeue_position_ + 1) {
+      break;
+    }
+    if (batch_.size() + slot.text.size() > kMaxBatchSize) {
+      WriteBatch();
+    }
+    batch_.append(slot.text);
+    // Hands the slot to the producer on the next lap.
+    slot.sequence.store(dequeue_position_ + queue_size_,
+                        std::memory_order_release);
+    ++dequeue_position_;
+  }
+  WriteBatch();
+}
+
+void AsyncWriter::WriteBatch() {
+  std::size_t written = 0;
+  while (written < batch_.size()) {
+    const ssize_t result =
+        write(fd_, batch_.data() + written, batch_.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // There is nowhere to report the error, so the batch is dropped.
+      break;
+    }
+    written += result;
+  }
+  batch_.clear();
+}
+
+void AsyncLogging::AppendLine(const PendingLine& line) {
+  writer_.Write(line.line());
+}
+
+void AsyncLogging::WriterOutput::WriteLine(const PendingLine& line) {
+  writer_->Write(line.line());
+}
+
+}  // namespace demo
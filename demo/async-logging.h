@@ -0,0 +1,142 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef ASYNC_LOGGING_H_
+#define ASYNC_LOGGING_H_
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "chunked-storage.h"
+#include "log-sink.h"
+#include "logging.h"
+
+namespace demo {
+
+// Writes lines to a file descriptor from a background thread, so that callers
+// never block on I/O. Callers only copy the line into a slot of a preallocated
+// lock-free ring; the writer thread empties the ring every flush_interval and
+// writes the lines with as few write(2) calls as possible.
+//
+// Slots keep their capacity, so copying a line doesn't allocate unless it's
+// longer than any line previously stored in the same slot. If the writer falls
+// behind by queue_size lines, callers wait for it rather than dropping lines.
+class AsyncWriter : public LogSink {
+ public:
+  explicit AsyncWriter(
+      int fd = STDERR_FILENO,
+      std::chrono::milliseconds flush_interval = std::chrono::milliseconds(10),
+      std::size_t queue_size = 1024);
+
+  // Writes all remaining lines before returning.
+  ~AsyncWriter();
+
+  void Write(Logging::Severity severity,
+             const std::shared_ptr<const std::string>& line) override;
+
+  void Write(capture_thread::testing::LineView line);
+
+  // Blocks until all lines written before the call have been written to the
+  // file descriptor.
+  void Flush();
+
+ private:
+  // A bounded multi-producer queue slot. sequence tells producers and the
+  // writer whose turn it is to use the slot.
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    std::string text;
+  };
+
+  void WriterThread();
+  void WritePending();
+  void WriteBatch();
+  // Wakes up the writer thread without waiting for it.
+  void Nudge();
+
+  const int fd_;
+  const std::chrono::milliseconds flush_interval_;
+  const std::size_t queue_size_;
+  const std::unique_ptr<Slot[]> slots_;
+  std::atomic<std::size_t> enqueue_position_{0};
+  // Only used by the writer thread, and by the destructor after it exits.
+  std::size_t dequeue_position_ = 0;
+  std::string batch_;
+  std::mutex writer_lock_;
+  std::condition_variable writer_wait_;
+  std::condition_variable flushed_wait_;
+  bool terminated_ = false;
+  int flush_requested_ = 0;
+  int flushed_ = 0;
+  std::thread writer_;
+};
+
+// Writes lines logged while in scope with an AsyncWriter. For example:
+//
+//   int main() {
+//     AsyncLogging async_logging;
+//     // ...
+//   }
+//
+// This also replaces stderr as the Logging::DefaultOutput, so lines that are
+// forwarded by a CaptureLogging nested in this scope are written here too.
+class AsyncLogging : public Logging {
+ public:
+  explicit AsyncLogging(
+      int fd = STDERR_FILENO,
+      std::chrono::milliseconds flush_interval = std::chrono::milliseconds(10))
+      : writer_(fd, flush_interval),
+        default_output_(&writer_),
+        cross_and_capture_to_(this) {}
+
+  // Blocks until all lines logged before the call have been written.
+  void Flush() { writer_.Flush(); }
+
+ protected:
+  void AppendLine(const PendingLine& line) override;
+
+ private:
+  class WriterOutput : public DefaultOutput {
+   public:
+    explicit WriterOutput(AsyncWriter* writer)
+        : writer_(writer), cross_and_capture_to_(this) {}
+
+   protected:
+    void WriteLine(const PendingLine& line) override;
+
+   private:
+    AsyncWriter* const writer_;
+    const AutoThreadCrosser cross_and_capture_to_;
+  };
+
+  AsyncWriter writer_;
+  WriterOutput default_output_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace demo
+
+#endif  // ASYNC_LOGGING_H_
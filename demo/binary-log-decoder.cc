@@ -0,0 +1,47 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+// Converts the output of BinaryLogging::WriteTo to text. Reads from the file
+// given as the only argument, or from stdin if there is none.
+
+#include <fstream>
+#include <iostream>
+
+#include "binary-logging.h"
+
+using demo::BinaryLogging;
+
+int main(int argc, char* argv[]) {
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [binary log]" << std::endl;
+    return 1;
+  }
+  std::ifstream file;
+  if (argc == 2) {
+    file.open(argv[1], std::ios::binary);
+    if (!file) {
+      std::cerr << "Failed to open " << argv[1] << std::endl;
+      return 1;
+    }
+  }
+  if (!BinaryLogging::Decode(argc == 2 ? file : std::cin, std::cout)) {
+    std::cerr << "Malformed or truncated binary log" << std::endl;
+    return 1;
+  }
+  return 0;
+}
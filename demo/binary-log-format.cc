@@ -0,0 +1,196 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <cinttypes>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "binary-log-format.h"
+#include "binary-logging.h"
+
+namespace demo {
+namespace binary_log {
+
+namespace {
+
+struct SiteInfo {
+  std::string file;
+  int line;
+  std::string format;
+};
+
+bool DecodeArgument(Reader* reader, std::string* output) {
+  using Tag = BinaryLogging::Tag;
+  Tag tag;
+  if (!reader->Read(&tag)) {
+    return false;
+  }
+  char formatted[32];
+  switch (tag) {
+    case Tag::kSigned: {
+      std::int64_t value;
+      if (!reader->Read(&value)) {
+        return false;
+      }
+      std::snprintf(formatted, sizeof formatted, "%" PRId64, value);
+      output->append(formatted);
+      return true;
+    }
+    case Tag::kUnsigned: {
+      std::uint64_t value;
+      if (!reader->Read(&value)) {
+        return false;
+      }
+      std::snprintf(formatted, sizeof formatted, "%" PRIu64, value);
+      output->append(formatted);
+      return true;
+    }
+    case Tag::kFloat: {
+      double value;
+      if (!reader->Read(&value)) {
+        return false;
+      }
+      std::snprintf(formatted, sizeof formatted, "%g", value);
+      output->append(formatted);
+      return true;
+    }
+    case Tag::kChar: {
+      char value;
+      if (!reader->Read(&value)) {
+        return false;
+      }
+      output->push_back(value);
+      return true;
+    }
+    case Tag::kString: {
+      std::string value;
+      if (!reader->ReadString(&value)) {
+        return false;
+      }
+      output->append(value);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+bool RenderRecord(const std::string& format, Reader* reader,
+                  std::string* output) {
+  std::uint8_t count;
+  if (!reader->Read(&count)) {
+    return false;
+  }
+  std::size_t position = 0;
+  for (int i = 0; i < count; ++i) {
+    const std::size_t next = format.find("{}", position);
+    if (next == std::string::npos) {
+      output->append(format, position, std::string::npos);
+      output->push_back(' ');
+      position = format.size();
+    } else {
+      output->append(format, position, next - position);
+      position = next + 2;
+    }
+    if (!DecodeArgument(reader, output)) {
+      return false;
+    }
+  }
+  output->append(format, position, std::string::npos);
+  return true;
+}
+
+}  // namespace binary_log
+
+using binary_log::Reader;
+using binary_log::RenderRecord;
+using binary_log::SiteInfo;
+using binary_log::kMagic;
+using binary_log::kMagicSize;
+using binary_log::kRecords;
+using binary_log::kSites;
+
+// static
+bool BinaryLogging::Decode(std::istream& input, std::ostream& output) {
+  char magic[kMagicSize];
+  if (!input.read(magic, kMagicSize) ||
+      std::memcmp(magic, kMagic, kMagicSize) != 0) {
+    return false;
+  }
+  std::vector<SiteInfo> sites;
+  while (input.peek() != std::char_traits<char>::eof()) {
+    char header[sizeof(std::uint8_t) + sizeof(std::uint32_t)];
+    if (!input.read(header, sizeof header)) {
+      return false;
+    }
+    Reader header_reader(header, sizeof header);
+    std::uint8_t kind;
+    std::uint32_t size;
+    header_reader.Read(&kind);
+    header_reader.Read(&size);
+    std::string data(size, '\0');
+    if (!input.read(&data[0], size)) {
+      return false;
+    }
+
+    Reader reader(data.data(), data.size());
+    // The first site ID for kSites, or the thread index for kRecords.
+    std::uint32_t index;
+    if (!reader.Read(&index)) {
+      return false;
+    }
+    if (kind == kSites) {
+      if (index != sites.size()) {
+        return false;
+      }
+      while (!reader.empty()) {
+        SiteInfo site;
+        std::int32_t line;
+        if (!reader.Read(&line) || !reader.ReadString(&site.file) ||
+            !reader.ReadString(&site.format)) {
+          return false;
+        }
+        site.line = line;
+        sites.push_back(std::move(site));
+      }
+    } else if (kind == kRecords) {
+      std::string text;
+      while (!reader.empty()) {
+        std::uint32_t id;
+        if (!reader.Read(&id) || id >= sites.size()) {
+          return false;
+        }
+        const SiteInfo& site = sites[id];
+        text.clear();
+        if (!RenderRecord(site.format, &reader, &text)) {
+          return false;
+        }
+        output << "[" << index << "] " << site.file << ":" << site.line
+               << ": " << text << "\n";
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace demo
@@ -0,0 +1,109 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef BINARY_LOG_FORMAT_H_
+#define BINARY_LOG_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace demo {
+namespace binary_log {
+
+// Encoding shared by BinaryLogging and BinaryLogging::Decode. Decode is kept
+// separate from the rest of BinaryLogging, so that binary-log-decoder doesn't
+// depend on the rest of the logging stack.
+//
+// Output of BinaryLogging::WriteTo:
+//
+//   kMagic, followed by any number of sections.
+//
+// Section:
+//   uint8 kind, uint32 size, followed by size bytes of data.
+//
+// kSites section data:
+//   uint32 ID of the first site, followed by sites with consecutive IDs.
+//   Site: int32 line, uint32 size + file, uint32 size + format.
+//
+// kRecords section data:
+//   uint32 thread index, followed by records from that thread, in order.
+//   Record: uint32 site ID, uint8 count, followed by count arguments.
+//   Argument: uint8 Tag, followed by the value; strings are uint32 size + data.
+
+constexpr char kMagic[] = "CTBLOG01";
+constexpr std::size_t kMagicSize = sizeof kMagic - 1;
+
+enum SectionKind : std::uint8_t { kSites = 1, kRecords = 2 };
+
+template <class Type>
+void AppendRaw(std::string* output, Type value) {
+  char raw[sizeof value];
+  std::memcpy(raw, &value, sizeof value);
+  output->append(raw, sizeof raw);
+}
+
+inline void AppendString(std::string* output, const char* data,
+                         std::size_t size) {
+  AppendRaw(output, static_cast<std::uint32_t>(size));
+  output->append(data, size);
+}
+
+// Bounds-checked sequential reads from encoded data.
+class Reader {
+ public:
+  Reader(const char* data, std::size_t size)
+      : position_(data), end_(data + size) {}
+
+  bool empty() const { return position_ == end_; }
+
+  template <class Type>
+  bool Read(Type* value) {
+    if (end_ - position_ < static_cast<std::ptrdiff_t>(sizeof *value)) {
+      return false;
+    }
+    std::memcpy(value, position_, sizeof *value);
+    position_ += sizeof *value;
+    return true;
+  }
+
+  bool ReadString(std::string* value) {
+    std::uint32_t size = 0;
+    if (!Read(&size) || end_ - position_ < static_cast<std::ptrdiff_t>(size)) {
+      return false;
+    }
+    value->assign(position_, size);
+    position_ += size;
+    return true;
+  }
+
+ private:
+  const char* position_;
+  const char* const end_;
+};
+
+// Decodes the arguments of a record, replacing each "{}" in format. Arguments
+// without a matching "{}" are appended, separated by spaces.
+bool RenderRecord(const std::string& format, Reader* reader,
+                  std::string* output);
+
+}  // namespace binary_log
+}  // namespace demo
+
+#endif  // BINARY_LOG_FORMAT_H_
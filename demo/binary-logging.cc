@@ -0,0 +1,139 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "binary-log-format.h"
+#include "binary-logging.h"
+#include "logging.h"
+
+namespace demo {
+
+using binary_log::AppendRaw;
+using binary_log::AppendString;
+using binary_log::Reader;
+using binary_log::RenderRecord;
+using binary_log::SectionKind;
+using binary_log::kMagic;
+using binary_log::kMagicSize;
+using binary_log::kRecords;
+using binary_log::kSites;
+
+namespace {
+
+struct SiteRegistry {
+  std::mutex lock;
+  std::vector<const BinaryLogSite*> sites;
+};
+
+// Never destroyed, since sites might be registered or used during static
+// initialization or destruction.
+SiteRegistry& Registry() {
+  static SiteRegistry* const registry = new SiteRegistry;
+  return *registry;
+}
+
+std::uint32_t RegisterSite(const BinaryLogSite* site) {
+  SiteRegistry& registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.lock);
+  registry.sites.push_back(site);
+  return registry.sites.size() - 1;
+}
+
+void WriteSection(std::ostream& output, SectionKind kind,
+                  const std::string& data) {
+  std::string header;
+  AppendRaw(&header, kind);
+  AppendRaw(&header, static_cast<std::uint32_t>(data.size()));
+  output << header << data;
+}
+
+}  // namespace
+
+BinaryLogSite::BinaryLogSite(const char* file, int line, const char* format)
+    : file_(file), line_(line), format_(format), id_(RegisterSite(this)) {}
+
+void BinaryLogging::WriteTo(std::ostream& output) {
+  std::lock_guard<std::mutex> write_lock(write_lock_);
+  if (!header_written_) {
+    output.write(kMagic, kMagicSize);
+    header_written_ = true;
+  }
+
+  std::string sites;
+  {
+    SiteRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    if (sites_written_ < registry.sites.size()) {
+      AppendRaw(&sites, sites_written_);
+      for (; sites_written_ < registry.sites.size(); ++sites_written_) {
+        const BinaryLogSite& site = *registry.sites[sites_written_];
+        AppendRaw(&sites, static_cast<std::int32_t>(site.line()));
+        AppendString(&sites, site.file(), std::strlen(site.file()));
+        AppendString(&sites, site.format(), std::strlen(site.format()));
+      }
+    }
+  }
+  if (!sites.empty()) {
+    WriteSection(output, kSites, sites);
+  }
+
+  std::uint32_t thread_index = 0;
+  records_.ForEach([&output, &thread_index](ThreadRecords& records) {
+    std::string bytes;
+    {
+      // Swapped out, so that the logging thread isn't blocked by the write.
+      std::lock_guard<std::mutex> lock(records.lock);
+      bytes.swap(records.bytes);
+    }
+    if (!bytes.empty()) {
+      std::string data;
+      AppendRaw(&data, thread_index);
+      WriteSection(output, kRecords, data + bytes);
+    }
+    ++thread_index;
+  });
+}
+
+// static
+void BinaryLogging::EncodeString(std::string* bytes, const char* data,
+                                 std::size_t size) {
+  EncodeRaw(bytes, Tag::kString);
+  AppendString(bytes, data, size);
+}
+
+// static
+void BinaryLogging::LogAsText(const std::string& bytes) {
+  // bytes was just encoded, so it doesn't need to be validated.
+  Reader reader(bytes.data(), bytes.size());
+  std::uint32_t id = 0;
+  reader.Read(&id);
+  std::string format;
+  {
+    SiteRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    format = registry.sites[id]->format();
+  }
+  std::string text;
+  RenderRecord(format, &reader, &text);
+  Logging::LogLine() << text;
+}
+
+}  // namespace demo
@@ -0,0 +1,179 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef BINARY_LOGGING_H_
+#define BINARY_LOGGING_H_
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "per-thread.h"
+#include "thread-capture.h"
+
+namespace demo {
+
+// A call site for BinaryLogging. Sites must be defined at namespace scope, so
+// that they are registered during static initialization. For example:
+//
+//   const BinaryLogSite kComputeSite(__FILE__, __LINE__, "Computing {} of {}");
+//
+//   void Compute(int value, int total) {
+//     BinaryLogging::Log(kComputeSite, value, total);
+//   }
+//
+// Each "{}" in format is replaced with the next argument when the record is
+// decoded.
+class BinaryLogSite {
+ public:
+  BinaryLogSite(const char* file, int line, const char* format);
+
+  std::uint32_t id() const { return id_; }
+  const char* file() const { return file_; }
+  int line() const { return line_; }
+  const char* format() const { return format_; }
+
+ private:
+  BinaryLogSite(const BinaryLogSite&) = delete;
+  BinaryLogSite(BinaryLogSite&&) = delete;
+  BinaryLogSite& operator=(const BinaryLogSite&) = delete;
+  BinaryLogSite& operator=(BinaryLogSite&&) = delete;
+
+  const char* const file_;
+  const int line_;
+  const char* const format_;
+  const std::uint32_t id_;
+};
+
+// Records log calls as binary data while in scope, rather than formatting
+// text. Each record only contains the site ID and the raw bytes of the
+// arguments; the format strings are written once per WriteTo call, and are
+// combined with the records offline by binary-log-decoder. Records are stored
+// per thread, so logging threads don't contend with each other.
+//
+// If no BinaryLogging is in scope, Log formats the line and logs it with
+// Logging::LogLine instead.
+//
+// Supported argument types are integers, floating-point numbers, characters,
+// const char*, and std::string. Data is written in the host byte order.
+class BinaryLogging : public capture_thread::ThreadCapture<BinaryLogging> {
+ public:
+  // Identifies the type of each encoded argument.
+  enum class Tag : std::uint8_t { kSigned, kUnsigned, kFloat, kChar, kString };
+
+  BinaryLogging() : cross_and_capture_to_(this) {}
+
+  template <class... Args>
+  static void Log(const BinaryLogSite& site, const Args&... args) {
+    if (GetCurrent()) {
+      ThreadRecords& records = GetCurrent()->records_.Local();
+      std::lock_guard<std::mutex> lock(records.lock);
+      EncodeRecord(&records.bytes, site, args...);
+    } else {
+      std::string bytes;
+      EncodeRecord(&bytes, site, args...);
+      LogAsText(bytes);
+    }
+  }
+
+  // Writes all records logged since the last call, along with any sites that
+  // haven't been written yet. The output of multiple calls can be concatenated.
+  void WriteTo(std::ostream& output);
+
+  // Converts the output of WriteTo to text, one line per record. Returns false
+  // if input is malformed or truncated.
+  static bool Decode(std::istream& input, std::ostream& output);
+
+ private:
+  struct ThreadRecords {
+    std::mutex lock;
+    std::string bytes;
+  };
+
+  template <class Type>
+  static void EncodeRaw(std::string* bytes, Type value) {
+    char raw[sizeof value];
+    std::memcpy(raw, &value, sizeof value);
+    bytes->append(raw, sizeof raw);
+  }
+
+  template <class... Args>
+  static void EncodeRecord(std::string* bytes, const BinaryLogSite& site,
+                           const Args&... args) {
+    EncodeRaw(bytes, site.id());
+    EncodeRaw(bytes, static_cast<std::uint8_t>(sizeof...(Args)));
+    const int unused[] = {0, (Encode(bytes, args), 0)...};
+    (void)unused;
+  }
+
+  template <class Type>
+  static typename std::enable_if<std::is_integral<Type>::value &&
+                                 std::is_signed<Type>::value>::type
+  Encode(std::string* bytes, Type value) {
+    EncodeRaw(bytes, Tag::kSigned);
+    EncodeRaw(bytes, static_cast<std::int64_t>(value));
+  }
+
+  template <class Type>
+  static typename std::enable_if<std::is_integral<Type>::value &&
+                                 std::is_unsigned<Type>::value>::type
+  Encode(std::string* bytes, Type value) {
+    EncodeRaw(bytes, Tag::kUnsigned);
+    EncodeRaw(bytes, static_cast<std::uint64_t>(value));
+  }
+
+  template <class Type>
+  static typename std::enable_if<std::is_floating_point<Type>::value>::type
+  Encode(std::string* bytes, Type value) {
+    EncodeRaw(bytes, Tag::kFloat);
+    EncodeRaw(bytes, static_cast<double>(value));
+  }
+
+  static void Encode(std::string* bytes, char value) {
+    EncodeRaw(bytes, Tag::kChar);
+    EncodeRaw(bytes, value);
+  }
+
+  static void Encode(std::string* bytes, const char* value) {
+    EncodeString(bytes, value, std::strlen(value));
+  }
+
+  static void Encode(std::string* bytes, const std::string& value) {
+    EncodeString(bytes, value.data(), value.size());
+  }
+
+  static void EncodeString(std::string* bytes, const char* data,
+                           std::size_t size);
+
+  static void LogAsText(const std::string& bytes);
+
+  std::mutex write_lock_;
+  std::uint32_t sites_written_ = 0;
+  bool header_written_ = false;
+  capture_thread::testing::PerThread<ThreadRecords> records_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace demo
+
+#endif  // BINARY_LOGGING_H_
@@ -0,0 +1,81 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <algorithm>
+#include <cassert>
+
+#include "fan-out-logging.h"
+
+namespace demo {
+
+FanOutLogging::FanOutLogging(const std::vector<Route>& routes)
+    : route_count_(routes.size()),
+      routes_(new RouteState[routes.size()]),
+      cross_and_capture_to_(this) {
+  for (std::size_t i = 0; i < route_count_; ++i) {
+    assert(routes[i].sink);
+    routes_[i].route = routes[i];
+  }
+}
+
+void FanOutLogging::AppendLine(const PendingLine& line) {
+  std::shared_ptr<const std::string> text;
+  for (std::size_t i = 0; i < route_count_; ++i) {
+    RouteState& state = routes_[i];
+    if (line.severity() < state.route.min_severity) {
+      continue;
+    }
+    if (state.route.sample_every > 1 &&
+        state.sample_count.fetch_add(1, std::memory_order_relaxed) %
+                state.route.sample_every !=
+            0) {
+      continue;
+    }
+    if (!text) {
+      // Only formatted once, and only if at least one sink accepts the line.
+      text = std::make_shared<const std::string>(line.line().str());
+    }
+    state.route.sink->Write(line.severity(), text);
+  }
+}
+
+RingLogSink::RingLogSink(std::size_t max_lines) : lines_(max_lines) {
+  assert(max_lines > 0);
+}
+
+void RingLogSink::Write(Logging::Severity severity,
+                        const std::shared_ptr<const std::string>& line) {
+  std::shared_ptr<const std::string> overwritten;
+  std::lock_guard<std::mutex> lock(data_lock_);
+  // The old line is released after the lock, in case this is the last owner.
+  overwritten.swap(lines_[next_ % lines_.size()]);
+  lines_[next_ % lines_.size()] = line;
+  ++next_;
+}
+
+std::vector<std::shared_ptr<const std::string>> RingLogSink::GetLines() {
+  std::vector<std::shared_ptr<const std::string>> lines;
+  std::lock_guard<std::mutex> lock(data_lock_);
+  const std::size_t count = std::min(next_, lines_.size());
+  for (std::size_t i = next_ - count; i < next_; ++i) {
+    lines.push_back(lines_[i % lines_.size()]);
+  }
+  return lines;
+}
+
+}  // namespace demo
@@ -0,0 +1,90 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef FAN_OUT_LOGGING_H_
+#define FAN_OUT_LOGGING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "log-sink.h"
+#include "logging.h"
+
+namespace demo {
+
+// Sends lines logged while in scope to multiple sinks, each with its own
+// filter. The message has already been formatted by LogLine when the filters
+// are checked, but the context prefix is only rendered (once, shared by all
+// sinks that accept the line) if at least one sink accepts it. For example:
+//
+//   RingLogSink recent(1000);
+//   AsyncWriter errors(error_fd);
+//   FanOutLogging logging({{&recent}, {&errors, Logging::Severity::kError}});
+class FanOutLogging : public Logging {
+ public:
+  struct Route {
+    LogSink* sink;
+    Severity min_severity;
+    // Only every Nth line that passes min_severity is sent to sink. Either 0
+    // or 1 sends every line.
+    int sample_every;
+  };
+
+  // Sinks are not owned, and must outlive this.
+  explicit FanOutLogging(const std::vector<Route>& routes);
+
+ protected:
+  void AppendLine(const PendingLine& line) override;
+
+ private:
+  struct RouteState {
+    Route route;
+    std::atomic<std::uint64_t> sample_count{0};
+  };
+
+  const std::size_t route_count_;
+  const std::unique_ptr<RouteState[]> routes_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+// Keeps the most recent lines in memory. Lines are shared with the other
+// sinks, so this doesn't copy them.
+class RingLogSink : public LogSink {
+ public:
+  explicit RingLogSink(std::size_t max_lines);
+
+  void Write(Logging::Severity severity,
+             const std::shared_ptr<const std::string>& line) override;
+
+  // Returns the retained lines, oldest first.
+  std::vector<std::shared_ptr<const std::string>> GetLines();
+
+ private:
+  std::mutex data_lock_;
+  std::vector<std::shared_ptr<const std::string>> lines_;
+  std::size_t next_ = 0;
+};
+
+}  // namespace demo
+
+#endif  // FAN_OUT_LOGGING_H_
@@ -0,0 +1,53 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef LOG_SINK_H_
+#define LOG_SINK_H_
+
+#include <memory>
+#include <string>
+
+#include "logging.h"
+
+namespace demo {
+
+// Destination for complete log lines, e.g., for use with FanOutLogging. Lines
+// are shared rather than copied, so a sink that needs to keep a line (e.g., to
+// write it later) can just keep the pointer. Implementations must be
+// thread-safe.
+class LogSink {
+ public:
+  virtual ~LogSink() = default;
+
+  // line includes the context prefix and the trailing newline.
+  virtual void Write(Logging::Severity severity,
+                     const std::shared_ptr<const std::string>& line) = 0;
+
+ protected:
+  LogSink() = default;
+
+ private:
+  LogSink(const LogSink&) = delete;
+  LogSink(LogSink&&) = delete;
+  LogSink& operator=(const LogSink&) = delete;
+  LogSink& operator=(LogSink&&) = delete;
+};
+
+}  // namespace demo
+
+#endif  // LOG_SINK_H_
@@ -16,45 +16,406 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <streambuf>
 
 #include "logging.h"
 #include "tracing.h"
 
+using capture_thread::testing::LineView;
+using capture_thread::testing::LogStamp;
+
 namespace demo {
 
-Logging::LogLine::LogLine() : capture_(GetCurrent()) {
-  const std::string context = Tracing::GetContext();
-  if (!context.empty()) {
-    *this << context << ": ";
+namespace {
+
+// Appends everything written to it to a std::string.
+class StringAppender : public std::streambuf {
+ public:
+  explicit StringAppender(std::string* output) : output_(output) {}
+
+ protected:
+  int_type overflow(int_type value) override {
+    if (!traits_type::eq_int_type(value, traits_type::eof())) {
+      output_->push_back(traits_type::to_char_type(value));
+    }
+    return traits_type::not_eof(value);
+  }
+
+  std::streamsize xsputn(const char* data, std::streamsize size) override {
+    output_->append(data, size);
+    return size;
+  }
+
+ private:
+  std::string* const output_;
+};
+
+// Size of a LogStamp as stored by CaptureLogging: each field is copied
+// separately, so that struct padding isn't stored with every line.
+constexpr std::size_t kEncodedStampSize =
+    sizeof(LogStamp().time_ns) + sizeof(LogStamp().thread);
+
+void EncodeStamp(const LogStamp& stamp, std::string* output) {
+  output->append(reinterpret_cast<const char*>(&stamp.time_ns),
+                 sizeof stamp.time_ns);
+  output->append(reinterpret_cast<const char*>(&stamp.thread),
+                 sizeof stamp.thread);
+}
+
+LogStamp DecodeStamp(const char* data) {
+  LogStamp stamp;
+  std::memcpy(&stamp.time_ns, data, sizeof stamp.time_ns);
+  std::memcpy(&stamp.thread, data + sizeof stamp.time_ns, sizeof stamp.thread);
+  return stamp;
+}
+
+}  // namespace
+
+// Holds the formatted line, along with a std::ostream for types that aren't
+// formatted directly. Both are reused across lines.
+class Logging::LogLine::Buffer {
+ public:
+  Buffer() : appender_(&line_), stream_(&appender_) {}
+
+  std::string& line() { return line_; }
+
+  std::ostream& stream() {
+    stream_used_ = true;
+    return stream_;
+  }
+
+  void Reset() {
+    // Very long lines shouldn't permanently increase memory usage.
+    if (line_.capacity() > kMaxRetainedSize) {
+      std::string().swap(line_);
+    } else {
+      line_.clear();
+    }
+    if (stream_used_) {
+      // Undoes any manipulators used in the previous line.
+      stream_.clear();
+      stream_.flags(std::ios_base::dec | std::ios_base::skipws);
+      stream_.precision(6);
+      stream_.width(0);
+      stream_.fill(' ');
+      stream_used_ = false;
+    }
+  }
+
+ private:
+  static constexpr std::size_t kMaxRetainedSize = 1 << 16;
+
+  std::string line_;
+  StringAppender appender_;
+  std::ostream stream_;
+  bool stream_used_ = false;
+};
+
+// LogLine are always destroyed in the reverse order of construction within a
+// thread, so the reusable buffers can be used as a stack.
+struct Logging::LogLine::BufferPool {
+  static BufferPool& Local() {
+    static thread_local BufferPool pool;
+    return pool;
+  }
+
+  static constexpr int kSize = 4;
+  std::unique_ptr<Buffer> buffers[kSize];
+  int in_use = 0;
+};
+
+// static
+Logging::LogLine::Buffer* Logging::LogLine::AcquireBuffer(
+    std::unique_ptr<Buffer>* owned) {
+  BufferPool& pool = BufferPool::Local();
+  if (pool.in_use < BufferPool::kSize) {
+    std::unique_ptr<Buffer>& buffer = pool.buffers[pool.in_use++];
+    if (!buffer) {
+      buffer.reset(new Buffer);
+    }
+    return buffer.get();
   } else {
-    *this << "(unknown context): ";
+    owned->reset(new Buffer);
+    return owned->get();
   }
 }
 
+// static
+std::atomic<Logging::Severity> Logging::min_severity_(Severity::kInfo);
+
+LineView Logging::PendingLine::message() const {
+  // The text always ends with a newline.
+  return LineView(text_->data() + prefix_size_,
+                  text_->size() - prefix_size_ - 1);
+}
+
+LineView Logging::PendingLine::line() const {
+  if (!has_prefix_) {
+    const std::string& context = Tracing::GetContext();
+    if (!context.empty()) {
+      text_->insert(0, ": ");
+      text_->insert(0, context);
+      prefix_size_ = context.size() + 2;
+    } else {
+      static const char kUnknown[] = "(unknown context): ";
+      text_->insert(0, kUnknown);
+      prefix_size_ = sizeof kUnknown - 1;
+    }
+    has_prefix_ = true;
+  }
+  return LineView(text_->data(), text_->size());
+}
+
+Logging::LogLine::LogLine(Severity severity)
+    : severity_(severity),
+      capture_(GetCurrent()),
+      buffer_(IsEnabled(severity) ? AcquireBuffer(&owned_buffer_) : nullptr) {}
+
 Logging::LogLine::~LogLine() {
-  *this << '\n';
-  if (capture_) {
-    capture_->AppendLine(output_.str());
+  if (!buffer_) {
+    return;
+  }
+  std::string& text = buffer_->line();
+  text.push_back('\n');
+  ForwardLine(capture_, PendingLine(severity_, &text));
+  if (!owned_buffer_) {
+    buffer_->Reset();
+    --BufferPool::Local().in_use;
+  }
+}
+
+template <class Type>
+Logging::LogLine& Logging::LogLine::AppendInteger(Type value) {
+  if (!buffer_) {
+    return *this;
+  }
+  if (use_stream_) {
+    Stream() << value;
+    return *this;
+  }
+  // Digits are generated in reverse, from the end of the array.
+  char formatted[24];
+  char* const end = formatted + sizeof formatted;
+  char* start = end;
+  const bool negative = value < 0;
+  do {
+    const int digit = static_cast<int>(value % 10);
+    *--start = '0' + (negative ? -digit : digit);
+    value /= 10;
+  } while (value != 0);
+  if (negative) {
+    *--start = '-';
+  }
+  buffer_->line().append(start, end - start);
+  return *this;
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(const char* value) {
+  if (!buffer_) {
+    return *this;
+  }
+  if (use_stream_) {
+    Stream() << value;
+  } else {
+    buffer_->line().append(value);
+  }
+  return *this;
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(const std::string& value) {
+  if (!buffer_) {
+    return *this;
+  }
+  if (use_stream_) {
+    Stream() << value;
+  } else {
+    buffer_->line().append(value);
+  }
+  return *this;
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(char value) {
+  if (!buffer_) {
+    return *this;
+  }
+  if (use_stream_) {
+    Stream() << value;
   } else {
-    DefaultAppendLine(output_.str());
+    buffer_->line().push_back(value);
   }
+  return *this;
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(bool value) {
+  // Matches std::ostream without std::boolalpha.
+  return *this << (value ? 1 : 0);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(int value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(long value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(long long value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(unsigned int value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(unsigned long value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(unsigned long long value) {
+  return AppendInteger(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(float value) {
+  return *this << static_cast<double>(value);
+}
+
+Logging::LogLine& Logging::LogLine::operator<<(double value) {
+  if (!buffer_) {
+    return *this;
+  }
+  if (use_stream_) {
+    Stream() << value;
+  } else {
+    // Same as the default std::ostream formatting, i.e., precision 6.
+    char formatted[32];
+    const int size = std::snprintf(formatted, sizeof formatted, "%g", value);
+    buffer_->line().append(formatted, size);
+  }
+  return *this;
+}
+
+std::ostream& Logging::LogLine::Stream() {
+  use_stream_ = true;
+  return buffer_->stream();
 }
 
 // static
-void Logging::DefaultAppendLine(const std::string& line) { std::cerr << line; }
+void Logging::DefaultAppendLine(const PendingLine& line) {
+  DefaultOutput* const output = DefaultOutput::GetCurrent();
+  if (output) {
+    output->WriteLine(line);
+  } else {
+    std::cerr << line.line();
+  }
+}
 
-std::list<std::string> CaptureLogging::CopyLines() {
-  std::lock_guard<std::mutex> lock(data_lock_);
-  return lines_;
+// static
+void Logging::ForwardLine(Logging* previous, const PendingLine& line) {
+  if (previous) {
+    previous->AppendLine(line);
+  } else {
+    DefaultAppendLine(line);
+  }
 }
 
-void CaptureLogging::AppendLine(const std::string& line) {
+// static
+void Logging::ForwardMessage(Logging* previous, Severity severity,
+                             const std::string& message) {
+  std::string text = message + "\n";
+  ForwardLine(previous, PendingLine(severity, &text));
+}
+
+capture_thread::testing::LineList CaptureLogging::CopyLines() {
+  capture_thread::testing::LineList lines;
   {
     std::lock_guard<std::mutex> lock(data_lock_);
-    lines_.emplace_back(line);
+    lines = RetainedLines();
+  }
+  return RenderStamps(std::move(lines));
+}
+
+capture_thread::testing::LineList CaptureLogging::DrainLines() {
+  capture_thread::testing::LineList lines;
+  {
+    std::lock_guard<std::mutex> lock(data_lock_);
+    if (older_lines_.empty()) {
+      lines.swap(lines_);
+    } else {
+      lines = RetainedLines();
+      older_lines_.clear();
+      lines_.clear();
+    }
+  }
+  return RenderStamps(std::move(lines));
+}
+
+void CaptureLogging::AppendLine(const PendingLine& line) {
+  if (policy_.sample_every > 1 &&
+      sample_count_.fetch_add(1, std::memory_order_relaxed) %
+              policy_.sample_every !=
+          0) {
+    return;
+  }
+  if (policy_.capture) {
+    LineView text = line.line();
+    if (policy_.stamp) {
+      // The stamp is stored in binary in front of the line.
+      thread_local std::string stamped;
+      stamped.clear();
+      EncodeStamp(LogStamp::Now(), &stamped);
+      stamped.append(text.data(), text.size());
+      text = LineView(stamped.data(), stamped.size());
+    }
+    std::lock_guard<std::mutex> lock(data_lock_);
+    if (policy_.max_lines > 0 && lines_.size() >= policy_.max_lines) {
+      older_lines_.swap(lines_);
+      lines_.clear();
+    }
+    lines_.Append(text.data(), text.size());
+  }
+  if (policy_.forward) {
+    DefaultAppendLine(line);
+  }
+}
+
+capture_thread::testing::LineList CaptureLogging::RetainedLines() const {
+  if (older_lines_.empty()) {
+    return lines_;
+  }
+  capture_thread::testing::LineList lines;
+  // older_lines_ only exists if max_lines is set, and is always full.
+  std::size_t skip = lines_.size();
+  for (const LineView& text : older_lines_) {
+    if (skip > 0) {
+      --skip;
+    } else {
+      lines.Append(text.data(), text.size());
+    }
+  }
+  for (const LineView& text : lines_) {
+    lines.Append(text.data(), text.size());
+  }
+  return lines;
+}
+
+capture_thread::testing::LineList CaptureLogging::RenderStamps(
+    capture_thread::testing::LineList lines) const {
+  if (!policy_.stamp) {
+    return lines;
+  }
+  capture_thread::testing::LineList rendered;
+  std::string text;
+  for (const LineView& line : lines) {
+    text.clear();
+    DecodeStamp(line.data()).AppendTo(&text);
+    text.append(line.data() + kEncodedStampSize,
+                line.size() - kEncodedStampSize);
+    rendered.Append(text);
   }
-  DefaultAppendLine(line);
+  return rendered;
 }
 
 }  // namespace demo
@@ -19,61 +19,258 @@ limitations under the License.
 #ifndef LOGGING_H_
 #define LOGGING_H_
 
-#include <list>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <sstream>
+#include <ostream>
 #include <string>
 
+#include "chunked-storage.h"
+#include "log-stamp.h"
 #include "thread-capture.h"
 
+// Lines with a severity below this are compiled out when logged with
+// DEMO_LOG. For example, build with -DDEMO_MIN_LOG_SEVERITY=kWarning to remove
+// all kDebug and kInfo lines.
+#ifndef DEMO_MIN_LOG_SEVERITY
+#define DEMO_MIN_LOG_SEVERITY kDebug
+#endif
+
+// Logs a line with the given severity, e.g., DEMO_LOG(kWarning) << "message";
+// The arguments are only evaluated if the severity is enabled.
+#define DEMO_LOG(severity)                                                 \
+  if (!::demo::Logging::IsEnabled(::demo::Logging::Severity::severity)) { \
+  } else                                                                   \
+    ::demo::Logging::LogLine(::demo::Logging::Severity::severity)
+
 namespace demo {
 
 // Provides a text-logging mechanism. By default sends data to stderr. Use
 // CaptureLogging to capture logged data.
 class Logging : public capture_thread::ThreadCapture<Logging> {
  public:
+  enum class Severity { kDebug, kInfo, kWarning, kError };
+
+  // Returns true if lines with the given severity are neither compiled out nor
+  // below the runtime threshold.
+  static bool IsEnabled(Severity severity) {
+    return IsCompiledIn(severity) &&
+           severity >= min_severity_.load(std::memory_order_relaxed);
+  }
+
+  // Sets the runtime threshold for all threads. The default is kInfo.
+  static void SetMinSeverity(Severity severity) {
+    min_severity_.store(severity, std::memory_order_relaxed);
+  }
+
+  class LogLine;
+
+  // A formatted line that is passed to AppendLine. The tracing context is only
+  // looked up if the line is actually used.
+  class PendingLine {
+   public:
+    Severity severity() const { return severity_; }
+
+    // Returns the message, without the context or the trailing newline.
+    capture_thread::testing::LineView message() const;
+
+    // Returns the complete line, i.e., "context: message\n". This must be
+    // called before AppendLine returns, on the same thread.
+    capture_thread::testing::LineView line() const;
+
+   private:
+    PendingLine(const PendingLine&) = delete;
+    PendingLine(PendingLine&&) = delete;
+    PendingLine& operator=(const PendingLine&) = delete;
+    PendingLine& operator=(PendingLine&&) = delete;
+
+    friend class Logging;
+    friend class LogLine;
+    PendingLine(Severity severity, std::string* text)
+        : severity_(severity), text_(text) {}
+
+    const Severity severity_;
+    std::string* const text_;
+    mutable bool has_prefix_ = false;
+    mutable std::size_t prefix_size_ = 0;
+  };
+
   // Formats and logs a line. Operates as a std::ostream. For example:
   //
   //   Logging::LogLine() << "Log message.";
+  //
+  // Nothing is formatted if severity isn't enabled; however, the arguments are
+  // still evaluated, unlike with DEMO_LOG.
+  //
+  // Lines are formatted into a buffer that is reused by the current thread, so
+  // logging doesn't allocate once the buffer has grown large enough. Strings,
+  // characters, and numbers are formatted directly; other types fall back to
+  // their std::ostream operator<<.
   class LogLine {
    public:
-    LogLine();
+    explicit LogLine(Severity severity = Severity::kInfo);
     ~LogLine();
 
+    LogLine& operator<<(const char* value);
+    LogLine& operator<<(const std::string& value);
+    LogLine& operator<<(char value);
+    LogLine& operator<<(bool value);
+    LogLine& operator<<(int value);
+    LogLine& operator<<(long value);
+    LogLine& operator<<(long long value);
+    LogLine& operator<<(unsigned int value);
+    LogLine& operator<<(unsigned long value);
+    LogLine& operator<<(unsigned long long value);
+    LogLine& operator<<(float value);
+    LogLine& operator<<(double value);
+
     template <class Type>
-    LogLine& operator<<(Type value) {
-      static_cast<std::ostream&>(output_) << value;
+    LogLine& operator<<(const Type& value) {
+      if (buffer_) {
+        Stream() << value;
+      }
       return *this;
     }
 
    private:
+    LogLine(const LogLine&) = delete;
+    LogLine(LogLine&&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+    LogLine& operator=(LogLine&&) = delete;
+
+    class Buffer;
+    struct BufferPool;
+
+    // Returns one of the thread's reusable buffers, or a new buffer stored in
+    // owned if they are all in use.
+    static Buffer* AcquireBuffer(std::unique_ptr<Buffer>* owned);
+
+    // Returns a std::ostream that appends to the buffer. Once this is used,
+    // numbers are also formatted with it for the rest of the line, so that
+    // manipulators such as std::hex are respected.
+    std::ostream& Stream();
+
+    template <class Type>
+    LogLine& AppendInteger(Type value);
+
+    const Severity severity_;
     Logging* const capture_;
-    std::ostringstream output_;
+    // Only used if all of the thread's reusable buffers are in use, e.g., if a
+    // line is logged while formatting another line.
+    std::unique_ptr<Buffer> owned_buffer_;
+    // nullptr if severity isn't enabled.
+    Buffer* const buffer_;
+    bool use_stream_ = false;
   };
 
  protected:
   Logging() = default;
   virtual ~Logging() = default;
 
-  virtual void AppendLine(const std::string& line) = 0;
+  virtual void AppendLine(const PendingLine& line) = 0;
+
+  // Replaces stderr as the destination of DefaultAppendLine while in scope.
+  // For example, AsyncLogging uses this so that lines forwarded by a nested
+  // CaptureLogging are also written without blocking on I/O.
+  class DefaultOutput : public capture_thread::ThreadCapture<DefaultOutput> {
+   protected:
+    DefaultOutput() = default;
+    virtual ~DefaultOutput() = default;
+
+    virtual void WriteLine(const PendingLine& line) = 0;
+
+   private:
+    DefaultOutput(const DefaultOutput&) = delete;
+    DefaultOutput(DefaultOutput&&) = delete;
+    DefaultOutput& operator=(const DefaultOutput&) = delete;
+    DefaultOutput& operator=(DefaultOutput&&) = delete;
+
+    friend class Logging;
+  };
+
+  // Writes line to the current DefaultOutput, or to stderr if there is none.
+  static void DefaultAppendLine(const PendingLine& line);
+
+  // Passes line to previous if it isn't nullptr, and to DefaultAppendLine
+  // otherwise. Use this to also send lines to an enclosing Logging.
+  static void ForwardLine(Logging* previous, const PendingLine& line);
 
-  static void DefaultAppendLine(const std::string& line);
+  // Like ForwardLine, but for a line that doesn't come from LogLine, e.g., a
+  // summary of other lines. message should not end with a newline.
+  static void ForwardMessage(Logging* previous, Severity severity,
+                             const std::string& message);
+
+ private:
+  static constexpr bool IsCompiledIn(Severity severity) {
+    return severity >= Severity::DEMO_MIN_LOG_SEVERITY;
+  }
+
+  static std::atomic<Severity> min_severity_;
 };
 
-// Captures lines logged with Logging while in scope.
+// Captures lines logged with Logging while in scope. By default, lines are
+// also written with DefaultAppendLine, i.e., to stderr or to the AsyncLogging
+// in scope, but they're never passed to an enclosing Logging.
 class CaptureLogging : public Logging {
  public:
-  CaptureLogging() : cross_and_capture_to_(this) {}
+  // Determines what happens to each line. For example, to keep only the most
+  // recent 1000 lines without writing them anywhere:
+  //
+  //   CaptureLogging::Policy policy;
+  //   policy.forward = false;
+  //   policy.max_lines = 1000;
+  //   CaptureLogging logger(policy);
+  struct Policy {
+    // Keeps lines for CopyLines and DrainLines.
+    bool capture = true;
+    // Also writes lines with DefaultAppendLine. Lines are never passed to an
+    // enclosing Logging.
+    bool forward = true;
+    // Only handles every Nth line; the rest are skipped before the context is
+    // looked up. The message itself has already been formatted by then, so
+    // this saves storage and output, not formatting.
+    int sample_every = 1;
+    // If positive, only the most recent max_lines captured lines are kept.
+    std::size_t max_lines = 0;
+    // Stores a LogStamp with each captured line. The stamps are only rendered
+    // (as a prefix of each line) by CopyLines and DrainLines.
+    bool stamp = false;
+  };
 
-  // Returns a copy of all lines captured.
-  std::list<std::string> CopyLines();
+  CaptureLogging() : CaptureLogging(Policy()) {}
+
+  explicit CaptureLogging(const Policy& policy)
+      : policy_(policy), cross_and_capture_to_(this) {}
+
+  // Returns a copy of all lines captured since the last call to DrainLines.
+  // This blocks logging threads for as long as the copy takes.
+  capture_thread::testing::LineList CopyLines();
+
+  // Removes and returns all lines captured since the last call to DrainLines.
+  // Unless max_lines is set, the storage is swapped out, so logging threads
+  // are only blocked for O(1) time. Use this for periodically exporting
+  // captured lines.
+  capture_thread::testing::LineList DrainLines();
 
  protected:
-  void AppendLine(const std::string& line) override;
+  void AppendLine(const PendingLine& line) override;
 
  private:
+  // Requires that data_lock_ is held.
+  capture_thread::testing::LineList RetainedLines() const;
+
+  capture_thread::testing::LineList RenderStamps(
+      capture_thread::testing::LineList lines) const;
+
+  const Policy policy_;
+  std::atomic<std::uint64_t> sample_count_{0};
   std::mutex data_lock_;
-  std::list<std::string> lines_;
+  // With max_lines, lines_ is moved to older_lines_ whenever it fills up, so
+  // that old lines can be discarded without copying the newer ones.
+  capture_thread::testing::LineList older_lines_;
+  capture_thread::testing::LineList lines_;
   const AutoThreadCrosser cross_and_capture_to_;
 };
 
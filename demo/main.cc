@@ -16,22 +16,22 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
-#include <cassert>
 #include <chrono>
-#include <list>
-#include <memory>
-#include <sstream>
+#include <fstream>
+#include <functional>
 #include <thread>
 
-#include "callback-queue.h"
+#include "async-logging.h"
 #include "logging.h"
+#include "span-recording.h"
+#include "thread-pool.h"
 #include "tracing.h"
 
 using capture_thread::ThreadCrosser;
-using capture_thread::testing::CallbackQueue;
-using demo::CaptureLogging;
+using capture_thread::testing::ThreadPool;
+using demo::AsyncLogging;
 using demo::Formatter;
-using demo::Logging;
+using demo::SpanRecording;
 using demo::Tracing;
 
 namespace {
@@ -39,55 +39,54 @@ namespace {
 // A unit of computation that can be parallelized.
 void Compute(int value) {
   Tracing context(__func__);
-  Logging::LogLine() << "Computing " << value;
+  DEMO_LOG(kInfo) << "Computing " << value;
   std::this_thread::sleep_for(std::chrono::milliseconds(value));
 }
 
-// A worker thread that executes whatever is in the queue.
-void QueueThread(int index, CallbackQueue* queue) {
-  assert(queue);
-  Tracing context((Formatter() << __func__ << '[' << index << ']').String());
-  Logging::LogLine() << "Thread starting";
-  while (queue->PopAndCall()) {
-  }
-  Logging::LogLine() << "Thread stopping";
-}
-
-// Worker threads don't need to be wrapped with ThreadCrosser::WrapCall if they
-// are just executing callbacks from a queue, but it can be helpful, e.g., for
-// tracing purposes.
-std::unique_ptr<std::thread> NewThread(std::function<void()> callback) {
-  return std::unique_ptr<std::thread>(
-      new std::thread(ThreadCrosser::WrapCall(std::move(callback))));
+// Adds per-worker context to the pool's worker threads.
+void WorkerThread(int id, const std::function<void()>& run) {
+  Tracing context((Formatter() << __func__ << '[' << id << ']').String());
+  DEMO_LOG(kInfo) << "Thread starting";
+  run();
+  DEMO_LOG(kInfo) << "Thread stopping";
 }
 
-}  // namespace
-
-int main() {
+// Distributes computations to a pool of worker threads.
+void Run() {
   Tracing context(__func__);
 
-  // Queue for passing work from the main thread to the worker threads. Created
-  // in a paused state.
-  CallbackQueue queue(false /*active*/);
+  // Pool for passing work from the main thread to the worker threads. Workers
+  // are started as the queue backs up, and are retired when they are idle. All
+  // workers start in the context of Run, regardless of when they start.
+  ThreadPool pool(1 /*min_threads*/, 3 /*max_threads*/,
+                  std::chrono::milliseconds(2) /*max_queue_wait*/,
+                  std::chrono::milliseconds(100) /*idle_timeout*/,
+                  &WorkerThread);
 
   for (int i = 0; i < 10; ++i) {
     // One callback per unit of work that can be parallelized.
-    queue.Push(ThreadCrosser::WrapCall(std::bind(&Compute, i)));
-  }
-
-  std::list<std::unique_ptr<std::thread>> threads;
-  for (int i = 0; i < 3; ++i) {
-    // An arbitrary number of threads.
-    threads.emplace_back(NewThread(std::bind(&QueueThread, i, &queue)));
+    pool.Push(ThreadCrosser::WrapCall(std::bind(&Compute, i)));
   }
 
   // Perform the computations.
+  pool.WaitUntilEmpty();
+  DEMO_LOG(kInfo) << "Finished with " << pool.ThreadCount() << " threads";
+}
 
-  queue.Activate();
-  queue.WaitUntilEmpty();
-  queue.Terminate();
+}  // namespace
 
-  for (const auto& thread : threads) {
-    thread->join();
+// If a path is passed, the timing of each Tracing scope is written to it as a
+// Chrome trace, which can be loaded into chrome://tracing or Perfetto.
+int main(int argc, char* argv[]) {
+  // Keeps writing to stderr off of the worker threads.
+  AsyncLogging async_logging;
+  SpanRecording recording;
+  {
+    Tracing context(__func__);
+    Run();
+  }
+  if (argc > 1) {
+    std::ofstream output(argv[1]);
+    recording.WriteChromeTrace(output);
   }
 }
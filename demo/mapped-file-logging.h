@@ -0,0 +1,48 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef MAPPED_FILE_LOGGING_H_
+#define MAPPED_FILE_LOGGING_H_
+
+#include "chunked-storage.h"
+#include "logging.h"
+#include "mapped-log-file.h"
+
+namespace demo {
+
+// Writes lines logged while in scope to a MappedLogFile, which avoids making a
+// syscall per line. file is not owned, and must outlive this.
+class MappedFileLogging : public Logging {
+ public:
+  explicit MappedFileLogging(capture_thread::testing::MappedLogFile* file)
+      : file_(file), cross_and_capture_to_(this) {}
+
+ protected:
+  void AppendLine(const PendingLine& line) override {
+    const capture_thread::testing::LineView text = line.line();
+    file_->AppendLine(text.data(), text.size());
+  }
+
+ private:
+  capture_thread::testing::MappedLogFile* const file_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace demo
+
+#endif  // MAPPED_FILE_LOGGING_H_
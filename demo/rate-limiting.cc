@@ -0,0 +1,172 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "rate-limiting.h"
+#include "thread-crosser.h"
+
+using capture_thread::ThreadCrosser;
+using capture_thread::testing::LineView;
+
+namespace demo {
+
+struct LogRateLimiter::Suppressed {
+  Suppressed(const char* new_file, int new_line, Logging::Severity new_severity)
+      : file(new_file), line(new_line), severity(new_severity) {}
+
+  const char* const file;
+  const int line;
+  const Logging::Severity severity;
+  std::atomic<std::uint64_t> count{0};
+  Suppressed* next = nullptr;
+};
+
+bool LogRateLimiter::Allow(Logging::Severity severity) {
+  const std::int64_t now_ns = now_ns_();
+  std::int64_t full_at_ns = full_at_ns_.load(std::memory_order_relaxed);
+  while (true) {
+    const std::int64_t start_ns = full_at_ns > now_ns ? full_at_ns : now_ns;
+    if (start_ns - now_ns > tolerance_ns_) {
+      GetSuppressed(severity)->count.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (full_at_ns_.compare_exchange_weak(full_at_ns, start_ns + interval_ns_,
+                                          std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  Suppressed* const suppressed = suppressed_.load(std::memory_order_acquire);
+  const std::uint64_t count =
+      suppressed ? suppressed->count.exchange(0, std::memory_order_relaxed)
+                 : 0;
+  if (count > 0) {
+    Logging::LogLine(severity) << "suppressed " << count << " similar lines";
+  }
+  return true;
+}
+
+// static
+void LogRateLimiter::ReportSuppressed() {
+  for (Suppressed* suppressed = AllSuppressed().load(std::memory_order_acquire);
+       suppressed; suppressed = suppressed->next) {
+    const std::uint64_t count =
+        suppressed->count.exchange(0, std::memory_order_relaxed);
+    if (count > 0) {
+      Logging::LogLine(suppressed->severity)
+          << "suppressed " << count << " similar lines from "
+          << suppressed->file << ":" << suppressed->line;
+    }
+  }
+}
+
+// static
+std::int64_t LogRateLimiter::SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+LogRateLimiter::Suppressed* LogRateLimiter::GetSuppressed(
+    Logging::Severity severity) {
+  Suppressed* suppressed = suppressed_.load(std::memory_order_acquire);
+  if (suppressed) {
+    return suppressed;
+  }
+  Suppressed* const created = new Suppressed(file_, line_, severity);
+  if (!suppressed_.compare_exchange_strong(suppressed, created,
+                                           std::memory_order_acq_rel)) {
+    // Another thread suppressed a line first.
+    delete created;
+    return suppressed;
+  }
+  std::atomic<Suppressed*>& all = AllSuppressed();
+  Suppressed* head = all.load(std::memory_order_relaxed);
+  do {
+    created->next = head;
+  } while (!all.compare_exchange_weak(head, created, std::memory_order_release,
+                                      std::memory_order_relaxed));
+  return created;
+}
+
+// static
+std::atomic<LogRateLimiter::Suppressed*>& LogRateLimiter::AllSuppressed() {
+  // Never destroyed, since limiters might be used during static destruction.
+  static std::atomic<Suppressed*>* const all =
+      new std::atomic<Suppressed*>(nullptr);
+  return *all;
+}
+
+RateLimitReporter::RateLimitReporter(std::chrono::milliseconds interval)
+    : interval_(interval),
+      reporter_(ThreadCrosser::WrapCall(
+          std::bind(&RateLimitReporter::ReporterThread, this))) {}
+
+RateLimitReporter::~RateLimitReporter() {
+  {
+    std::lock_guard<std::mutex> lock(reporter_lock_);
+    terminated_ = true;
+    reporter_wait_.notify_all();
+  }
+  reporter_.join();
+  LogRateLimiter::ReportSuppressed();
+}
+
+void RateLimitReporter::ReporterThread() {
+  std::unique_lock<std::mutex> lock(reporter_lock_);
+  while (!reporter_wait_.wait_for(lock, interval_,
+                                  [this] { return terminated_; })) {
+    lock.unlock();
+    LogRateLimiter::ReportSuppressed();
+    lock.lock();
+  }
+}
+
+DedupLogging::~DedupLogging() {
+  std::lock_guard<std::mutex> lock(data_lock_);
+  ForwardRepeats();
+}
+
+void DedupLogging::AppendLine(const PendingLine& line) {
+  const LineView message = line.message();
+  std::lock_guard<std::mutex> lock(data_lock_);
+  if (has_last_ && line.severity() == last_severity_ &&
+      message == last_message_) {
+    ++repeats_;
+    return;
+  }
+  ForwardRepeats();
+  last_severity_ = line.severity();
+  last_message_.assign(message.data(), message.size());
+  has_last_ = true;
+  // The lock is held, so that the repeat count can't be logged before this.
+  ForwardLine(cross_and_capture_to_.Previous(), line);
+}
+
+void DedupLogging::ForwardRepeats() {
+  if (repeats_ > 0) {
+    ForwardMessage(cross_and_capture_to_.Previous(), last_severity_,
+                   "previous line repeated " + std::to_string(repeats_) +
+                       " more times");
+    repeats_ = 0;
+  }
+}
+
+}  // namespace demo
@@ -0,0 +1,174 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef RATE_LIMITING_H_
+#define RATE_LIMITING_H_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "logging.h"
+
+// Like DEMO_LOG, but logs at most per_second lines per second from this call
+// site, after an initial burst of up to burst lines. The next line that is
+// logged after lines are suppressed is preceded by a count of the suppressed
+// lines. If no line is logged after a burst, the count is only logged by a
+// RateLimitReporter. For example:
+//
+//   DEMO_LOG_RATE_LIMITED(kWarning, 1, 5) << "Request failed: " << error;
+#define DEMO_LOG_RATE_LIMITED(severity, per_second, burst)                 \
+  if (!::demo::Logging::IsEnabled(::demo::Logging::Severity::severity) || \
+      ![]() -> ::demo::LogRateLimiter& {                                   \
+        static ::demo::LogRateLimiter limiter(per_second, burst, __FILE__, \
+                                              __LINE__);                   \
+        return limiter;                                                    \
+      }().Allow(::demo::Logging::Severity::severity)) {                    \
+  } else                                                                   \
+    ::demo::Logging::LogLine(::demo::Logging::Severity::severity)
+
+namespace demo {
+
+// Token bucket for a single call site. The constructor is constexpr and the
+// destructor is trivial, so that a static instance is initialized without any
+// locking. Use DEMO_LOG_RATE_LIMITED rather than using this directly.
+class LogRateLimiter {
+ public:
+  // Returns the current time in nanoseconds.
+  using NowFunction = std::int64_t (*)();
+
+  // per_second and burst must be positive. file and line identify the call
+  // site in counts logged by ReportSuppressed; file must never be freed, e.g.,
+  // __FILE__. now_ns can be replaced for testing.
+  constexpr LogRateLimiter(double per_second, int burst,
+                           const char* file = "", int line = 0,
+                           NowFunction now_ns = &SteadyNowNs)
+      : interval_ns_((assert(per_second > 0),
+                      static_cast<std::int64_t>(1e9 / per_second))),
+        tolerance_ns_((assert(burst > 0),
+                       static_cast<std::int64_t>(1e9 / per_second) *
+                           (burst - 1))),
+        file_(file),
+        line_(line),
+        now_ns_(now_ns) {}
+
+  // Returns true if a line can be logged now. If so, and lines have been
+  // suppressed since their count was last logged, a line with the count is
+  // logged with the given severity first.
+  bool Allow(Logging::Severity severity);
+
+  // Logs the count of lines that each limiter has suppressed since the count
+  // was last logged, in the current context, using the severity of the
+  // suppressed lines. Only limiters with a nonzero count log anything.
+  static void ReportSuppressed();
+
+  static std::int64_t SteadyNowNs();
+
+ private:
+  LogRateLimiter(const LogRateLimiter&) = delete;
+  LogRateLimiter(LogRateLimiter&&) = delete;
+  LogRateLimiter& operator=(const LogRateLimiter&) = delete;
+  LogRateLimiter& operator=(LogRateLimiter&&) = delete;
+
+  // The count of suppressed lines, allocated the first time a limiter
+  // suppresses a line and never freed. This lets ReportSuppressed read counts
+  // without synchronizing with the destruction of limiters, and keeps the
+  // destructor of LogRateLimiter trivial.
+  struct Suppressed;
+
+  Suppressed* GetSuppressed(Logging::Severity severity);
+
+  // Every Suppressed ever allocated. Nodes are only added at the head, so that
+  // ReportSuppressed can traverse the list without locking.
+  static std::atomic<Suppressed*>& AllSuppressed();
+
+  const std::int64_t interval_ns_;
+  const std::int64_t tolerance_ns_;
+  const char* const file_;
+  const int line_;
+  const NowFunction now_ns_;
+  // The time at which the bucket will be full again. This is equivalent to
+  // tracking the number of tokens, but only requires a single atomic.
+  std::atomic<std::int64_t> full_at_ns_{0};
+  std::atomic<Suppressed*> suppressed_{nullptr};
+};
+
+// Calls LogRateLimiter::ReportSuppressed every interval from a background
+// thread, and once more when destroyed, so that the count of a burst of
+// suppressed lines is logged even if no line is logged after the burst. The
+// counts are logged in the context that the reporter was created in. For
+// example:
+//
+//   int main() {
+//     RateLimitReporter reporter(std::chrono::seconds(10));
+//     // ...
+//   }
+class RateLimitReporter {
+ public:
+  explicit RateLimitReporter(std::chrono::milliseconds interval);
+  ~RateLimitReporter();
+
+ private:
+  RateLimitReporter(const RateLimitReporter&) = delete;
+  RateLimitReporter(RateLimitReporter&&) = delete;
+  RateLimitReporter& operator=(const RateLimitReporter&) = delete;
+  RateLimitReporter& operator=(RateLimitReporter&&) = delete;
+
+  void ReporterThread();
+
+  const std::chrono::milliseconds interval_;
+  std::mutex reporter_lock_;
+  std::condition_variable reporter_wait_;
+  bool terminated_ = false;
+  std::thread reporter_;
+};
+
+// Folds consecutive identical lines logged while in scope into a single line,
+// followed by a count of the repeats. Only the severity and message are
+// compared, i.e., not the tracing context. Lines are passed on to the
+// enclosing Logging, if any, or to stderr.
+class DedupLogging : public Logging {
+ public:
+  DedupLogging() : cross_and_capture_to_(this) {}
+
+  // Logs the count of repeats of the last line, if any.
+  ~DedupLogging();
+
+ protected:
+  void AppendLine(const PendingLine& line) override;
+
+ private:
+  // Requires that data_lock_ is held.
+  void ForwardRepeats();
+
+  std::mutex data_lock_;
+  Severity last_severity_ = Severity::kDebug;
+  std::string last_message_;
+  bool has_last_ = false;
+  int repeats_ = 0;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace demo
+
+#endif  // RATE_LIMITING_H_
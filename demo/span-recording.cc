@@ -0,0 +1,325 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include "log-sink.h"
+#include "log-stamp.h"
+#include "logging.h"
+#include "span-recording.h"
+#include "tracing.h"
+
+using capture_thread::testing::LogStamp;
+
+namespace demo {
+
+namespace {
+
+void WriteJsonString(std::ostream& output, const std::string& value) {
+  output << '"';
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      output << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof escaped, "\\u%04x", c);
+      output << escaped;
+    } else {
+      output << c;
+    }
+  }
+  output << '"';
+}
+
+// Trace events use microseconds.
+void WriteMicros(std::ostream& output, std::int64_t ns) {
+  char formatted[32];
+  std::snprintf(formatted, sizeof formatted, "%lld.%03lld",
+                static_cast<long long>(ns / 1000),
+                static_cast<long long>(ns % 1000));
+  output << formatted;
+}
+
+// Writes the complete event for span, preceded by *separator. If flow is true,
+// also writes a flow event from the parent's thread at flow_start_ns.
+void WriteSpanEvents(std::ostream& output, const SpanRecording::Span& span,
+                     std::int64_t origin_ns, bool flow,
+                     std::int64_t flow_start_ns, const char** separator) {
+  output << *separator << "{\"name\":";
+  WriteJsonString(output, span.name->str());
+  output << ",\"cat\":\"tracing\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+         << span.thread() << ",\"ts\":";
+  WriteMicros(output, span.start_ns - origin_ns);
+  output << ",\"dur\":";
+  WriteMicros(output, span.end_ns - span.start_ns);
+  output << ",\"args\":{\"span\":" << span.id << ",\"parent\":" << span.parent
+         << "}}";
+  *separator = ",\n";
+  if (!flow) {
+    return;
+  }
+  output << *separator << "{\"name\":\"ThreadCrosser\",\"cat\":\"tracing\","
+         << "\"ph\":\"s\",\"id\":" << span.id
+         << ",\"pid\":1,\"tid\":" << span.parent_thread() << ",\"ts\":";
+  WriteMicros(output, flow_start_ns - origin_ns);
+  output << "}" << *separator
+         << "{\"name\":\"ThreadCrosser\",\"cat\":\"tracing\","
+         << "\"ph\":\"f\",\"bp\":\"e\",\"id\":" << span.id
+         << ",\"pid\":1,\"tid\":" << span.thread() << ",\"ts\":";
+  WriteMicros(output, span.start_ns - origin_ns);
+  output << "}";
+}
+
+// xorshift32, since sampling doesn't need good randomness, and std::minstd_rand
+// would need to be seeded per thread anyway.
+std::uint32_t NextRandom() {
+  thread_local std::uint32_t state = 0x9e3779b9 * LogStamp::CurrentThread();
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+std::size_t RoundUpToPowerOf2(std::size_t size) {
+  std::size_t rounded = 1;
+  while (rounded < size) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+}  // namespace
+
+SpanRecording::SpanRecording(const Policy& policy)
+    : ring_size_(RoundUpToPowerOf2(policy.ring_size)),
+      export_interval_(policy.export_interval),
+      export_to_(policy.export_to),
+      sample_threshold_(
+          policy.probability >= 1.0
+              ? UINT32_MAX
+              : static_cast<std::uint32_t>(
+                    std::max(0.0, policy.probability) * UINT32_MAX)),
+      sample_interval_ns_(policy.max_per_second > 0
+                              ? static_cast<std::int64_t>(
+                                    1000000000.0 / policy.max_per_second)
+                              : 0),
+      exporter_(&SpanRecording::ExporterThread, this),
+      cross_and_capture_to_(this) {}
+
+SpanRecording::~SpanRecording() {
+  {
+    std::lock_guard<std::mutex> lock(exporter_lock_);
+    terminated_ = true;
+    exporter_wait_.notify_all();
+  }
+  exporter_.join();
+  // Picks up anything recorded after the exporter's last pass.
+  ExportPending();
+  if (export_to_) {
+    // Closes the JSON array.
+    export_to_->Write(Logging::Severity::kInfo,
+                      std::make_shared<const std::string>(
+                          export_started_ ? "\n]\n" : "[]\n"));
+  }
+}
+
+// static
+std::uint64_t SpanRecording::NewSpanId() {
+  thread_local std::uint32_t next_span = 0;
+  if (++next_span == 0) {
+    // Wrapped around; the lower bits alone are never 0.
+    ++next_span;
+  }
+  return static_cast<std::uint64_t>(LogStamp::CurrentThread()) << 32 |
+         next_span;
+}
+
+// static
+std::int64_t SpanRecording::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void SpanRecording::Flush() {
+  std::unique_lock<std::mutex> lock(exporter_lock_);
+  const int requested = ++flush_requested_;
+  exporter_wait_.notify_all();
+  while (flushed_ < requested && !terminated_) {
+    exported_wait_.wait(lock);
+  }
+}
+
+std::uint64_t SpanRecording::GetDropped() {
+  std::uint64_t dropped = 0;
+  rings_.ForEach([&dropped](SpanRing& ring) {
+    dropped += ring.dropped.load(std::memory_order_relaxed);
+  });
+  return dropped;
+}
+
+std::vector<SpanRecording::Span> SpanRecording::CopySpans() {
+  Flush();
+  std::vector<Span> spans;
+  {
+    std::lock_guard<std::mutex> lock(spans_lock_);
+    spans = spans_;
+  }
+  std::sort(spans.begin(), spans.end(),
+            [](const Span& left, const Span& right) {
+              return left.start_ns < right.start_ns ||
+                     (left.start_ns == right.start_ns && left.id < right.id);
+            });
+  return spans;
+}
+
+void SpanRecording::WriteChromeTrace(std::ostream& output) {
+  const std::vector<Span> spans = CopySpans();
+  std::unordered_map<std::uint64_t, const Span*> by_id;
+  for (const Span& span : spans) {
+    by_id[span.id] = &span;
+  }
+  // Times are relative to the first span, to keep the numbers readable.
+  const std::int64_t origin = spans.empty() ? 0 : spans.front().start_ns;
+  const char* separator = "\n";
+  output << "{\"traceEvents\":[";
+  for (const Span& span : spans) {
+    const auto parent = by_id.find(span.parent);
+    const bool flow =
+        parent != by_id.end() && span.parent_thread() != span.thread();
+    // The start of a flow must be within a span on its own thread, but the
+    // parent might have ended before the callback started executing.
+    WriteSpanEvents(
+        output, span, origin, flow,
+        flow ? std::min(span.start_ns, parent->second->end_ns) : 0,
+        &separator);
+  }
+  output << "\n]}\n";
+}
+
+bool SpanRecording::Sample() {
+  if (sample_threshold_ < UINT32_MAX && NextRandom() >= sample_threshold_) {
+    return false;
+  }
+  if (sample_interval_ns_ == 0) {
+    return true;
+  }
+  const std::int64_t now = NowNs();
+  std::int64_t next = next_sample_ns_.load(std::memory_order_relaxed);
+  do {
+    if (now < next) {
+      return false;
+    }
+  } while (!next_sample_ns_.compare_exchange_weak(
+      next, now + sample_interval_ns_, std::memory_order_relaxed));
+  return true;
+}
+
+void SpanRecording::Add(const Span& span) {
+  SpanRing& ring = rings_.Local();
+  if (!ring.slots) {
+    ring.slots.reset(new Span[ring_size_]);
+  }
+  const std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+  if (tail - ring.head.load(std::memory_order_acquire) == ring_size_) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring.slots[tail & (ring_size_ - 1)] = span;
+  // Publishes the slot (and the allocation of slots) to the exporter.
+  ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+void SpanRecording::ExporterThread() {
+  std::unique_lock<std::mutex> lock(exporter_lock_);
+  while (true) {
+    exporter_wait_.wait_for(lock, export_interval_, [this] {
+      return terminated_ || flushed_ < flush_requested_;
+    });
+    const int requested = flush_requested_;
+    const bool terminated = terminated_;
+    lock.unlock();
+    ExportPending();
+    lock.lock();
+    flushed_ = requested;
+    exported_wait_.notify_all();
+    if (terminated) {
+      break;
+    }
+  }
+}
+
+// static
+void* SpanRecording::SpanRing::operator new(std::size_t size) {
+  void* ring = nullptr;
+  if (posix_memalign(&ring, alignof(SpanRing), size) != 0) {
+    throw std::bad_alloc();
+  }
+  return ring;
+}
+
+// static
+void SpanRecording::SpanRing::operator delete(void* ring) { std::free(ring); }
+
+void SpanRecording::ExportPending() {
+  rings_.ForEach([this](SpanRing& ring) {
+    const std::size_t head = ring.head.load(std::memory_order_relaxed);
+    const std::size_t tail = ring.tail.load(std::memory_order_acquire);
+    if (head == tail) {
+      // Avoids taking the cache line away from the owning thread.
+      return;
+    }
+    for (std::size_t i = head; i != tail; ++i) {
+      batch_.push_back(ring.slots[i & (ring_size_ - 1)]);
+    }
+    // Releases the slots back to the owning thread.
+    ring.head.store(tail, std::memory_order_release);
+  });
+  if (batch_.empty()) {
+    return;
+  }
+  if (export_to_) {
+    // Spans are streamed, so parents usually haven't been exported yet when
+    // their children are. Flows therefore start when the child starts.
+    std::ostringstream output;
+    const char* separator = export_started_ ? ",\n" : "[\n";
+    export_started_ = true;
+    for (const Span& span : batch_) {
+      WriteSpanEvents(output, span, 0,
+                      span.parent && span.parent_thread() != span.thread(),
+                      span.start_ns, &separator);
+    }
+    export_to_->Write(Logging::Severity::kInfo,
+                      std::make_shared<const std::string>(output.str()));
+  } else {
+    std::lock_guard<std::mutex> lock(spans_lock_);
+    spans_.insert(spans_.end(), batch_.begin(), batch_.end());
+  }
+  batch_.clear();
+}
+
+}  // namespace demo
@@ -0,0 +1,201 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#ifndef SPAN_RECORDING_H_
+#define SPAN_RECORDING_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "per-thread.h"
+#include "thread-capture.h"
+
+namespace demo {
+
+class LogSink;
+class TraceName;
+
+// Records the start and end times of Tracing scopes while in scope, so that
+// they can be exported for latency analysis. Crosses threads along with
+// Tracing, so the spans of callbacks wrapped with ThreadCrosser are linked to
+// the span that was current when the callback was wrapped. For example:
+//
+//   SpanRecording recording;
+//   HandleRequest(request);
+//   std::ofstream output("trace.json");
+//   recording.WriteChromeTrace(output);
+//
+// If no SpanRecording is in scope, Tracing doesn't read the clock at all.
+//
+// Each thread writes finished spans to its own fixed-size ring buffer without
+// locking, and a single exporter thread periodically moves them out of all of
+// the rings. If a thread's ring is full, its spans are dropped and counted
+// rather than blocking the thread.
+//
+// Sampling is decided once per request, when a root Tracing scope (one with no
+// enclosing Tracing) is created. Every scope under an unsampled root, including
+// those on other threads via ThreadCrosser, skips span IDs and timing. Those
+// scopes still intern their names and paths, so that Tracing::GetContext (and
+// therefore the DEMO_LOG prefix) is the same whether or not a request is
+// sampled.
+class SpanRecording : public capture_thread::ThreadCapture<SpanRecording> {
+ public:
+  struct Span {
+    const TraceName* name;
+    // Unique span ID, or 0 for no span. The upper 32 bits are the thread.
+    std::uint64_t id;
+    // The span that was current when this span started, possibly from another
+    // thread, or 0 if there was none.
+    std::uint64_t parent;
+    std::int64_t start_ns;
+    std::int64_t end_ns;
+
+    std::uint32_t thread() const { return id >> 32; }
+    std::uint32_t parent_thread() const { return parent >> 32; }
+  };
+
+  // Determines which requests are traced. For example, to trace 1% of
+  // requests, but no more than 10 per second:
+  //
+  //   SpanRecording::Policy policy;
+  //   policy.probability = 0.01;
+  //   policy.max_per_second = 10;
+  //   SpanRecording recording(policy);
+  struct Policy {
+    // Probability that each root scope is sampled.
+    double probability = 1.0;
+    // If positive, limits the rate of sampled root scopes, after applying
+    // probability. Roots are spaced at least 1 / max_per_second apart.
+    double max_per_second = 0.0;
+    // Number of spans each thread can buffer between exports. Rounded up to a
+    // power of 2.
+    std::size_t ring_size = 4096;
+    // How often the exporter thread empties the rings.
+    std::chrono::milliseconds export_interval = std::chrono::milliseconds(10);
+    // If set, each batch of spans is written to export_to as trace events,
+    // rather than being kept for CopySpans and WriteChromeTrace. The output
+    // uses the JSON Array Format, and is a complete JSON array once the
+    // SpanRecording is destroyed.
+    LogSink* export_to = nullptr;
+  };
+
+  SpanRecording() : SpanRecording(Policy()) {}
+
+  explicit SpanRecording(const Policy& policy);
+
+  // Exports all remaining spans before returning.
+  ~SpanRecording();
+
+  static bool IsActive() { return GetCurrent() != nullptr; }
+
+  // Decides whether a new root Tracing scope is sampled. Always true if no
+  // SpanRecording is in scope.
+  static bool SampleRoot() { return !GetCurrent() || GetCurrent()->Sample(); }
+
+  // Returns a new, nonzero span ID for the calling thread. This doesn't
+  // synchronize with other threads. The upper 32 bits are the thread and the
+  // lower 32 bits count that thread's spans, skipping 0, so IDs are only
+  // reused after a thread has started 2^32 - 1 spans.
+  static std::uint64_t NewSpanId();
+
+  // Monotonic time with full clock resolution.
+  static std::int64_t NowNs();
+
+  // Records a finished span with the current SpanRecording, if any. Never
+  // blocks; the span is dropped if the calling thread's ring is full.
+  static void Record(const Span& span) {
+    if (GetCurrent()) {
+      GetCurrent()->Add(span);
+    }
+  }
+
+  // Blocks until all spans recorded before the call have been exported.
+  void Flush();
+
+  // Returns the number of spans dropped because a ring was full.
+  std::uint64_t GetDropped();
+
+  // Returns all spans recorded so far, ordered by start time.
+  std::vector<Span> CopySpans();
+
+  // Writes all spans recorded so far in the Chrome trace-event JSON format,
+  // which can be loaded by chrome://tracing and Perfetto. Spans whose parent
+  // is on another thread are connected to the parent with a flow event.
+  void WriteChromeTrace(std::ostream& output);
+
+ private:
+  // Single-producer, single-consumer queue. The owning thread pushes, and the
+  // exporter thread drains.
+  // The owning thread writes tail and dropped, and the exporter writes head,
+  // so they're kept on separate cache lines. The ring itself is allocated
+  // with cache-line alignment, so that it doesn't share a line with anything
+  // else either.
+  struct SpanRing {
+    // C++11 operator new ignores alignment beyond alignof(std::max_align_t).
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ring);
+
+    // The slots are allocated on first use, since PerThread requires a
+    // default constructor.
+    std::unique_ptr<Span[]> slots;
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::atomic<std::uint64_t> dropped{0};
+    alignas(64) std::atomic<std::size_t> head{0};
+  };
+
+  bool Sample();
+  void Add(const Span& span);
+
+  void ExporterThread();
+  void ExportPending();
+
+  const std::size_t ring_size_;
+  const std::chrono::milliseconds export_interval_;
+  LogSink* const export_to_;
+
+  // Converted from the Policy, so that Sample doesn't need floating point.
+  const std::uint32_t sample_threshold_;
+  const std::int64_t sample_interval_ns_;
+  std::atomic<std::int64_t> next_sample_ns_{0};
+  capture_thread::testing::PerThread<SpanRing> rings_;
+  // Only used by the exporter thread, and by the destructor after it exits.
+  std::vector<Span> batch_;
+  bool export_started_ = false;
+  std::mutex spans_lock_;
+  std::vector<Span> spans_;
+  std::mutex exporter_lock_;
+  std::condition_variable exporter_wait_;
+  std::condition_variable exported_wait_;
+  bool terminated_ = false;
+  int flush_requested_ = 0;
+  int flushed_ = 0;
+  std::thread exporter_;
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+}  // namespace demo
+
+#endif  // SPAN_RECORDING_H_
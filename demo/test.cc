@@ -16,21 +16,52 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <unistd.h>
+
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "async-logging.h"
+#include "binary-logging.h"
 #include "callback-queue.h"
+#include "fan-out-logging.h"
 #include "logging.h"
+#include "mapped-file-logging.h"
+#include "mapped-log-file.h"
+#include "rate-limiting.h"
+#include "span-recording.h"
 #include "tracing.h"
 
 using capture_thread::ThreadCrosser;
 using capture_thread::testing::CallbackQueue;
+using capture_thread::testing::MappedLogFile;
 using testing::ElementsAre;
+using testing::MatchesRegex;
 
 namespace demo {
 
+namespace {
+
+const BinaryLogSite kTestSite("test.cc", 1, "value {} of {}:");
+const BinaryLogSite kOtherSite("test.cc", 2, "{}");
+
+// The clock used by LogRateLimiter in tests.
+std::int64_t fake_now_ns = 0;
+std::int64_t FakeNowNs() { return fake_now_ns; }
+
+}  // namespace
+
 TEST(DemoTest, IntegrationTest) {
   CaptureLogging logger;
   Tracing context("test");
@@ -62,6 +93,477 @@ TEST(DemoTest, IntegrationTest) {
                           "test:worker: stop\n"));
 }
 
+TEST(DemoTest, TracingContextIsComputedOnce) {
+  EXPECT_EQ("", Tracing::GetContext());
+  Tracing outer("outer");
+  Tracing inner("inner");
+  EXPECT_EQ("outer:inner", Tracing::GetContext());
+  EXPECT_EQ(&Tracing::GetContext(), &Tracing::GetContext());
+  std::thread worker(ThreadCrosser::WrapCall([] {
+    Tracing context("worker");
+    EXPECT_EQ("outer:inner:worker", Tracing::GetContext());
+  }));
+  worker.join();
+}
+
+TEST(DemoTest, TracingNamesAreInterned) {
+  const TraceName* const name = TraceName::Intern(std::string("dynamic"));
+  EXPECT_EQ(name, TraceName::Intern("dynamic", 7));
+  EXPECT_NE(name, TraceName::Intern("dynamic2", 8));
+  EXPECT_EQ("dynamic", name->str());
+  Tracing outer("outer");
+  const std::string* context = nullptr;
+  {
+    Tracing inner(name);
+    EXPECT_EQ(name, inner.name());
+    EXPECT_EQ("outer:dynamic", Tracing::GetContext());
+    context = &Tracing::GetContext();
+  }
+  std::thread worker(ThreadCrosser::WrapCall([name, context] {
+    Tracing inner(std::string("dynamic"));
+    EXPECT_EQ(name, inner.name());
+    EXPECT_EQ(context, &Tracing::GetContext());
+  }));
+  worker.join();
+  char buffer[16] = "dynamic";
+  Tracing from_buffer(buffer);
+  EXPECT_EQ(name, from_buffer.name());
+}
+
+TEST(DemoTest, SpanRecordingLinksSpansAcrossThreads) {
+  SpanRecording recording;
+  {
+    Tracing outer("outer");
+    std::thread worker(ThreadCrosser::WrapCall([] { Tracing inner("inner"); }));
+    worker.join();
+  }
+  Tracing unrecorded("unrecorded");
+  const std::vector<SpanRecording::Span> spans = recording.CopySpans();
+  ASSERT_EQ(2, spans.size());
+  EXPECT_EQ("outer", spans[0].name->str());
+  EXPECT_EQ(0, spans[0].parent);
+  EXPECT_EQ("inner", spans[1].name->str());
+  EXPECT_EQ(spans[0].id, spans[1].parent);
+  EXPECT_NE(spans[0].thread(), spans[1].thread());
+  EXPECT_LE(spans[0].start_ns, spans[1].start_ns);
+  EXPECT_LE(spans[1].end_ns, spans[0].end_ns);
+
+  std::ostringstream output;
+  recording.WriteChromeTrace(output);
+  EXPECT_THAT(output.str(),
+              MatchesRegex("\\{\"traceEvents\":\\[.*"
+                           "\"name\":\"outer\".*\"ph\":\"X\".*"
+                           "\"name\":\"inner\".*\"ph\":\"X\".*"
+                           "\"ph\":\"s\".*\"ph\":\"f\".*\\]\\}\n"));
+}
+
+TEST(DemoTest, SpanRecordingSamplesWholeRequests) {
+  SpanRecording::Policy policy;
+  policy.max_per_second = 0.001;
+  SpanRecording recording(policy);
+  for (int i = 0; i < 2; ++i) {
+    Tracing root("root");
+    std::thread worker(ThreadCrosser::WrapCall([i] {
+      Tracing inner("inner");
+      EXPECT_EQ(i == 0, Tracing::IsSampled());
+      EXPECT_EQ("root:inner", Tracing::GetContext());
+    }));
+    worker.join();
+  }
+  const std::vector<SpanRecording::Span> spans = recording.CopySpans();
+  ASSERT_EQ(2, spans.size());
+  EXPECT_EQ("root", spans[0].name->str());
+  EXPECT_EQ("inner", spans[1].name->str());
+}
+
+TEST(DemoTest, SpanRecordingSkipsUnsampledScopes) {
+  SpanRecording::Policy policy;
+  policy.probability = 0.0;
+  SpanRecording recording(policy);
+  Tracing root("root");
+  Tracing inner(std::string("inner"));
+  EXPECT_FALSE(Tracing::IsSampled());
+  EXPECT_EQ("inner", inner.name()->str());
+  EXPECT_EQ("root:inner", Tracing::GetContext());
+  EXPECT_TRUE(recording.CopySpans().empty());
+}
+
+TEST(DemoTest, SpanRecordingDropsSpansWhenRingIsFull) {
+  SpanRecording::Policy policy;
+  policy.ring_size = 2;
+  policy.export_interval = std::chrono::hours(1);
+  SpanRecording recording(policy);
+  for (int i = 0; i < 5; ++i) {
+    Tracing context("test");
+  }
+  EXPECT_EQ(3, recording.GetDropped());
+  EXPECT_EQ(2, recording.CopySpans().size());
+  // Exporting frees up the ring.
+  { Tracing context("test"); }
+  EXPECT_EQ(3, recording.GetDropped());
+  EXPECT_EQ(3, recording.CopySpans().size());
+}
+
+TEST(DemoTest, SpanRecordingExportsBatchesToSink) {
+  RingLogSink sink(100);
+  {
+    SpanRecording::Policy policy;
+    policy.export_to = &sink;
+    SpanRecording recording(policy);
+    Tracing outer("outer");
+    recording.Flush();
+    std::thread worker(ThreadCrosser::WrapCall([] { Tracing inner("inner"); }));
+    worker.join();
+    recording.Flush();
+    EXPECT_TRUE(recording.CopySpans().empty());
+  }
+  std::string output;
+  for (const auto& batch : sink.GetLines()) {
+    output += *batch;
+  }
+  EXPECT_THAT(output,
+              MatchesRegex("\\[\n\\{\"name\":\"inner\".*\"ph\":\"X\".*"
+                           "\"ph\":\"s\".*\"ph\":\"f\".*,\n"
+                           "\\{\"name\":\"outer\".*\n\\]\n"));
+}
+
+TEST(DemoTest, DrainLinesRemovesCapturedLines) {
+  CaptureLogging logger;
+  Tracing context("test");
+  Logging::LogLine() << "line 1";
+  EXPECT_THAT(logger.DrainLines(), ElementsAre("test: line 1\n"));
+  EXPECT_THAT(logger.CopyLines(), ElementsAre());
+  Logging::LogLine() << "line 2";
+  EXPECT_THAT(logger.DrainLines(), ElementsAre("test: line 2\n"));
+}
+
+TEST(DemoTest, CapturePolicyControlsForwarding) {
+  CaptureLogging outer;
+  Tracing context("test");
+  {
+    CaptureLogging::Policy policy;
+    policy.forward = false;
+    CaptureLogging capture_only(policy);
+    Logging::LogLine() << "not forwarded";
+    EXPECT_THAT(capture_only.CopyLines(), ElementsAre("test: not forwarded\n"));
+  }
+  {
+    CaptureLogging::Policy policy;
+    policy.capture = false;
+    CaptureLogging forward_only(policy);
+    Logging::LogLine() << "forwarded";
+    EXPECT_THAT(forward_only.CopyLines(), ElementsAre());
+  }
+  // Forwarding only writes to stderr, so the outer capture sees nothing.
+  EXPECT_THAT(outer.CopyLines(), ElementsAre());
+}
+
+TEST(DemoTest, CapturePolicySamplesAndLimitsLines) {
+  CaptureLogging::Policy policy;
+  policy.forward = false;
+  policy.sample_every = 2;
+  policy.max_lines = 3;
+  CaptureLogging logger(policy);
+  Tracing context("test");
+  for (int i = 0; i < 6; ++i) {
+    Logging::LogLine() << i;
+  }
+  EXPECT_THAT(logger.CopyLines(),
+              ElementsAre("test: 0\n", "test: 2\n", "test: 4\n"));
+  for (int i = 6; i < 12; ++i) {
+    Logging::LogLine() << i;
+  }
+  EXPECT_THAT(logger.DrainLines(),
+              ElementsAre("test: 6\n", "test: 8\n", "test: 10\n"));
+  Logging::LogLine() << 12;
+  EXPECT_THAT(logger.CopyLines(), ElementsAre("test: 12\n"));
+}
+
+TEST(DemoTest, RateLimitingSuppressesBursts) {
+  CaptureLogging logger;
+  Tracing context("test");
+  fake_now_ns = 1000000000;
+  LogRateLimiter limiter(10 /*per_second*/, 2 /*burst*/, "test.cc", 1,
+                         &FakeNowNs);
+  const auto log = [&limiter](int i) {
+    if (limiter.Allow(Logging::Severity::kInfo)) {
+      Logging::LogLine() << i;
+    }
+  };
+  for (int i = 0; i < 5; ++i) {
+    log(i);
+  }
+  fake_now_ns += 150000000;
+  log(5);
+  EXPECT_THAT(logger.CopyLines(),
+              ElementsAre("test: 0\n", "test: 1\n",
+                          "test: suppressed 3 similar lines\n", "test: 5\n"));
+}
+
+TEST(DemoTest, RateLimitedMacroUsesStaticLimiter) {
+  CaptureLogging logger;
+  Tracing context("test");
+  for (int i = 0; i < 3; ++i) {
+    // The limiter outlives the test, so only the first line of the first run
+    // (e.g., with --gtest_repeat) is logged.
+    DEMO_LOG_RATE_LIMITED(kInfo, 0.001 /*per_second*/, 1 /*burst*/) << i;
+  }
+  // Also clears the count, so that it isn't logged by other tests.
+  LogRateLimiter::ReportSuppressed();
+  const auto lines = logger.CopyLines();
+  ASSERT_FALSE(lines.empty());
+  EXPECT_THAT(lines.back().str(),
+              MatchesRegex("test: suppressed [23] similar lines from "
+                           ".*test.cc:[0-9]+\n"));
+}
+
+TEST(DemoTest, RateLimitReporterLogsCountsAfterBurstEnds) {
+  CaptureLogging logger;
+  Tracing context("test");
+  fake_now_ns = 1000000000;
+  LogRateLimiter limiter(10 /*per_second*/, 1 /*burst*/, "test.cc", 2,
+                         &FakeNowNs);
+  {
+    // Long enough that only the destructor reports.
+    RateLimitReporter reporter(std::chrono::hours(1));
+    for (int i = 0; i < 4; ++i) {
+      if (limiter.Allow(Logging::Severity::kWarning)) {
+        Logging::LogLine() << i;
+      }
+    }
+  }
+  EXPECT_THAT(logger.CopyLines(),
+              ElementsAre("test: 0\n",
+                          "test: suppressed 3 similar lines from test.cc:2\n"));
+  // The count is reset once it's logged.
+  LogRateLimiter::ReportSuppressed();
+  EXPECT_EQ(2, logger.CopyLines().size());
+}
+
+TEST(DemoTest, DedupLoggingFoldsRepeatedLines) {
+  CaptureLogging logger;
+  Tracing context("test");
+  {
+    DedupLogging dedup;
+    Logging::LogLine() << "a";
+    Logging::LogLine() << "a";
+    Logging::LogLine() << "a";
+    Logging::LogLine() << "b";
+    Logging::LogLine(Logging::Severity::kError) << "b";
+    Logging::LogLine(Logging::Severity::kError) << "b";
+  }
+  EXPECT_THAT(logger.CopyLines(),
+              ElementsAre("test: a\n",
+                          "test: previous line repeated 2 more times\n",
+                          "test: b\n", "test: b\n",
+                          "test: previous line repeated 1 more times\n"));
+}
+
+TEST(DemoTest, FanOutLoggingFiltersEachSink) {
+  RingLogSink all(10 /*max_lines*/);
+  RingLogSink errors(10 /*max_lines*/);
+  RingLogSink sampled(10 /*max_lines*/);
+  FanOutLogging logging({{&all},
+                         {&errors, Logging::Severity::kError},
+                         {&sampled, Logging::Severity::kDebug, 2}});
+  Tracing context("test");
+  Logging::LogLine() << "line 1";
+  Logging::LogLine(Logging::Severity::kError) << "line 2";
+  Logging::LogLine() << "line 3";
+
+  const auto lines = all.GetLines();
+  ASSERT_EQ(3, lines.size());
+  EXPECT_EQ("test: line 1\n", *lines[0]);
+  EXPECT_EQ("test: line 2\n", *lines[1]);
+  EXPECT_EQ("test: line 3\n", *lines[2]);
+  // The same line is shared by all of the sinks.
+  EXPECT_THAT(errors.GetLines(), ElementsAre(lines[1]));
+  EXPECT_THAT(sampled.GetLines(), ElementsAre(lines[0], lines[2]));
+}
+
+TEST(DemoTest, CapturePolicyStampsLines) {
+  CaptureLogging::Policy policy;
+  policy.forward = false;
+  policy.stamp = true;
+  CaptureLogging logger(policy);
+  Tracing context("test");
+  Logging::LogLine() << "line 1";
+  const auto lines = logger.DrainLines();
+  ASSERT_EQ(1, lines.size());
+  EXPECT_THAT(lines.front().str(),
+              MatchesRegex("\\[[0-9]+\\.[0-9]{6} T[0-9]+\\] test: line 1\n"));
+}
+
+TEST(DemoTest, FormatsLikeStdOstream) {
+  CaptureLogging logger;
+  Tracing context("test");
+  Logging::LogLine() << 0 << ' ' << -12 << ' ' << LLONG_MIN << ' ' << 7u << ' '
+                     << true << ' ' << 1.5 << ' ' << 0.1f << ' ' << 1e20;
+  Logging::LogLine() << 255 << std::hex << ' ' << 255 << ' ' << "x";
+  // Manipulators don't carry over to the next line.
+  Logging::LogLine() << 255;
+  EXPECT_THAT(
+      logger.CopyLines(),
+      ElementsAre("test: 0 -12 -9223372036854775808 7 1 1.5 0.1 1e+20\n",
+                  "test: 255 ff x\n", "test: 255\n"));
+}
+
+TEST(DemoTest, LoggingWhileFormattingALine) {
+  CaptureLogging logger;
+  Tracing context("test");
+  // Nesting deeper than the number of reusable buffers.
+  std::function<std::string(int)> format = [&format](int depth) {
+    if (depth > 0) {
+      Logging::LogLine() << "depth " << depth << ": " << format(depth - 1);
+    }
+    return std::to_string(depth);
+  };
+  format(6);
+  EXPECT_THAT(logger.CopyLines(),
+              ElementsAre("test: depth 1: 0\n", "test: depth 2: 1\n",
+                          "test: depth 3: 2\n", "test: depth 4: 3\n",
+                          "test: depth 5: 4\n", "test: depth 6: 5\n"));
+}
+
+TEST(DemoTest, SeverityBelowThresholdIsNotFormatted) {
+  CaptureLogging logger;
+  Tracing context("test");
+  int evaluated = 0;
+  DEMO_LOG(kDebug) << ++evaluated;
+  DEMO_LOG(kWarning) << ++evaluated;
+  Logging::SetMinSeverity(Logging::Severity::kError);
+  DEMO_LOG(kWarning) << ++evaluated;
+  Logging::LogLine(Logging::Severity::kWarning) << "not logged";
+  Logging::SetMinSeverity(Logging::Severity::kInfo);
+  EXPECT_EQ(1, evaluated);
+  EXPECT_THAT(logger.CopyLines(), ElementsAre("test: 1\n"));
+}
+
+TEST(DemoTest, AsyncWriterWaitsForSpaceWhenQueueIsFull) {
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  std::string expected;
+  {
+    // The writer only wakes up early because the queue fills up.
+    AsyncWriter writer(pipe_fds[1], std::chrono::seconds(60), 2);
+    for (int i = 0; i < 10; ++i) {
+      const std::string line = "line " + std::to_string(i) + "\n";
+      writer.Write(capture_thread::testing::LineView(line.data(), line.size()));
+      expected += line;
+    }
+  }
+  std::string written(expected.size(), '\0');
+  ASSERT_EQ(expected.size(), read(pipe_fds[0], &written[0], written.size()));
+  EXPECT_EQ(expected, written);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+TEST(DemoTest, AsyncLoggingWritesCapturedLinesToFd) {
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  {
+    // A long interval, so that the test depends on Flush.
+    AsyncLogging async_logging(pipe_fds[1], std::chrono::seconds(60));
+    Tracing context("test");
+    Logging::LogLine() << "line 1";
+    {
+      // Forwarded to async_logging's writer, rather than to stderr.
+      CaptureLogging logger;
+      Logging::LogLine() << "line 2";
+      EXPECT_THAT(logger.CopyLines(), ElementsAre("test: line 2\n"));
+    }
+    std::thread worker(
+        ThreadCrosser::WrapCall([] { Logging::LogLine() << "line 3"; }));
+    worker.join();
+    async_logging.Flush();
+    const std::string expected = "test: line 1\ntest: line 2\ntest: line 3\n";
+    std::string written(expected.size(), '\0');
+    ASSERT_EQ(expected.size(), read(pipe_fds[0], &written[0], written.size()));
+    EXPECT_EQ(expected, written);
+    Logging::LogLine() << "line 4";
+  }
+  // The destructor writes the remaining line.
+  char remaining[64];
+  const std::string expected = "test: line 4\n";
+  ASSERT_EQ(expected.size(), read(pipe_fds[0], remaining, sizeof remaining));
+  EXPECT_EQ(expected, std::string(remaining, expected.size()));
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+TEST(DemoTest, BinaryLoggingDecodesToText) {
+  std::ostringstream binary;
+  {
+    BinaryLogging logger;
+    BinaryLogging::Log(kTestSite, 1, 2u, 'x', "string", std::string("more"));
+    std::thread worker(ThreadCrosser::WrapCall([] {
+      BinaryLogging::Log(kOtherSite, -1.5, static_cast<int64_t>(-7));
+    }));
+    worker.join();
+    logger.WriteTo(binary);
+    BinaryLogging::Log(kOtherSite, "later");
+    logger.WriteTo(binary);
+  }
+  std::istringstream input(binary.str());
+  std::ostringstream text;
+  EXPECT_TRUE(BinaryLogging::Decode(input, text));
+  EXPECT_EQ(
+      "[0] test.cc:1: value 1 of 2: x string more\n"
+      "[1] test.cc:2: -1.5 -7\n"
+      "[0] test.cc:2: later\n",
+      text.str());
+
+  std::istringstream truncated(binary.str().substr(0, binary.str().size() - 1));
+  EXPECT_FALSE(BinaryLogging::Decode(truncated, text));
+}
+
+TEST(DemoTest, BinaryLoggingFallsBackToText) {
+  CaptureLogging logger;
+  Tracing context("test");
+  BinaryLogging::Log(kTestSite, 1, 2);
+  EXPECT_THAT(logger.CopyLines(), ElementsAre("test: value 1 of 2:\n"));
+}
+
+TEST(DemoTest, MappedFileLoggingWritesLines) {
+  const std::string prefix =
+      testing::TempDir() + "demo-mapped-" + std::to_string(getpid());
+  {
+    MappedLogFile file(prefix, 4096 /*segment_size*/);
+    MappedFileLogging logger(&file);
+    Tracing context("test");
+    Logging::LogLine() << "line 1";
+    Logging::LogLine() << "line 2";
+  }
+  std::ifstream segment(prefix + ".0");
+  std::ostringstream text;
+  text << segment.rdbuf();
+  unlink((prefix + ".0").c_str());
+  EXPECT_EQ("test: line 1\ntest: line 2\n", text.str());
+}
+
+class MessageLogger : public Logging {
+ public:
+  MessageLogger() : cross_and_capture_to_(this) {}
+
+  std::vector<std::string> messages;
+
+ protected:
+  void AppendLine(const PendingLine& line) override {
+    messages.push_back(line.message());
+  }
+
+ private:
+  const AutoThreadCrosser cross_and_capture_to_;
+};
+
+TEST(DemoTest, MessageExcludesContext) {
+  MessageLogger logger;
+  Tracing context("test");
+  Logging::LogLine(Logging::Severity::kError) << "message";
+  EXPECT_THAT(logger.messages, ElementsAre("message"));
+}
+
 }  // namespace demo
 
 int main(int argc, char *argv[]) {
@@ -16,31 +16,131 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
-#include <cassert>
-#include <iostream>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 
 #include "tracing.h"
 
 namespace demo {
 
-// static
-std::string Tracing::GetContext() {
-  Formatter formatter;
-  ReverseTrace(GetCurrent(), &formatter);
-  return formatter.String();
+namespace {
+
+// Lock-free hash table of interned objects, which are never removed. Each
+// bucket is a linked list that only grows at its head, so readers can traverse
+// it without any synchronization other than loading the head.
+template <class Node>
+class InternTable {
+ public:
+  // Returns the node in the bucket for hash that matches, or else the node
+  // returned by create, which must be a new node that matches. next is the
+  // member used to link nodes in the same bucket.
+  template <class Matches, class Create>
+  const Node* FindOrAdd(std::size_t hash, const Node* Node::*next,
+                        Matches matches, Create create) {
+    std::atomic<const Node*>& bucket = buckets_[hash % kBuckets];
+    const Node* head = bucket.load(std::memory_order_acquire);
+    const Node* searched_until = nullptr;
+    Node* added = nullptr;
+    while (true) {
+      for (const Node* node = head; node != searched_until;
+           node = node->*next) {
+        if (matches(*node)) {
+          // Another thread added the same node first.
+          delete added;
+          return node;
+        }
+      }
+      searched_until = head;
+      if (!added) {
+        added = create();
+      }
+      added->*next = head;
+      if (bucket.compare_exchange_weak(head, added, std::memory_order_release,
+                                       std::memory_order_acquire)) {
+        return added;
+      }
+    }
+  }
+
+ private:
+  static constexpr std::size_t kBuckets = 4096;
+  std::atomic<const Node*> buckets_[kBuckets] = {};
+};
+
+// FNV-1a.
+std::size_t HashText(const char* data, std::size_t size) {
+  std::size_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Combines two pointers into a hash. Pointers to heap objects are aligned, so
+// their low bits are always zero, and std::hash just returns the pointer. The
+// bits are therefore mixed with the 64-bit finalizer from MurmurHash3.
+std::size_t HashPointers(const void* first, const void* second) {
+  std::uint64_t hash = reinterpret_cast<std::uintptr_t>(first) * 31 +
+                       reinterpret_cast<std::uintptr_t>(second);
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return static_cast<std::size_t>(hash);
 }
 
+}  // namespace
+
 // static
-void Tracing::ReverseTrace(const Tracing* tracer, Formatter* formatter) {
-  assert(formatter);
-  if (tracer) {
-    const auto previous = tracer->cross_and_capture_to_.Previous();
-    ReverseTrace(previous, formatter);
-    if (previous) {
-      *formatter << ":";
-    }
-    *formatter << tracer->name();
+const TraceName* TraceName::Intern(const char* data, std::size_t size) {
+  // Never destroyed, since names might be used during static destruction.
+  static InternTable<TraceName>* const table = new InternTable<TraceName>;
+  return table->FindOrAdd(
+      HashText(data, size), &TraceName::next_,
+      [data, size](const TraceName& name) {
+        return name.name_.size() == size &&
+               std::memcmp(name.name_.data(), data, size) == 0;
+      },
+      [data, size] { return new TraceName(std::string(data, size)); });
+}
+
+Tracing::~Tracing() {
+  if (span_) {
+    SpanRecording::Record(
+        {path_->name, span_, parent_span_, start_ns_, SpanRecording::NowNs()});
   }
 }
 
+// static
+const std::string& Tracing::GetContext() {
+  static const std::string* const empty = new std::string;
+  return GetCurrent() ? GetCurrent()->path_->text : *empty;
+}
+
+// static
+const Tracing::Path* Tracing::Enter(const Tracing* parent, const Name& name) {
+  return Path::Intern(parent ? parent->path_ : nullptr,
+                      name.interned ? name.interned
+                                    : TraceName::Intern(name.data, name.size));
+}
+
+// static
+const Tracing::Path* Tracing::Path::Intern(const Path* parent,
+                                           const TraceName* name) {
+  static InternTable<Path>* const table = new InternTable<Path>;
+  return table->FindOrAdd(
+      HashPointers(parent, name), &Path::next,
+      [parent, name](const Path& path) {
+        return path.parent == parent && path.name == name;
+      },
+      [parent, name] {
+        return new Path{parent, name,
+                        parent ? parent->text + ":" + name->str()
+                               : name->str(),
+                        nullptr};
+      });
+}
+
 }  // namespace demo
@@ -19,11 +19,13 @@ limitations under the License.
 #ifndef TRACING_H_
 #define TRACING_H_
 
-#include <list>
-#include <mutex>
+#include <cstddef>
+#include <cstdint>
 #include <sstream>
 #include <string>
+#include <utility>
 
+#include "span-recording.h"
 #include "thread-capture.h"
 
 namespace demo {
@@ -46,11 +48,62 @@ class Formatter {
   std::ostringstream output_;
 };
 
-// Adds a named tracing scope while the object is in scope.
+// A name for a Tracing scope, interned in a global table. Interned names are
+// never freed, so a scope only needs to store a pointer. Intern names that are
+// computed at runtime once, rather than every time a scope is created:
+//
+//   static const TraceName* const kName = TraceName::Intern(ComputeName());
+//   Tracing context(kName);
+class TraceName {
+ public:
+  // Returns the unique TraceName with the given text. This only allocates the
+  // first time a given name is interned, and never blocks.
+  static const TraceName* Intern(const char* data, std::size_t size);
+  static const TraceName* Intern(const std::string& name) {
+    return Intern(name.data(), name.size());
+  }
+
+  const std::string& str() const { return name_; }
+
+ private:
+  TraceName(const TraceName&) = delete;
+  TraceName(TraceName&&) = delete;
+  TraceName& operator=(const TraceName&) = delete;
+  TraceName& operator=(TraceName&&) = delete;
+
+  explicit TraceName(std::string name) : name_(std::move(name)) {}
+
+  const std::string name_;
+  const TraceName* next_ = nullptr;
+};
+
+// Adds a named tracing scope while the object is in scope. Creating a scope
+// doesn't allocate once its name has been used in the same context before. If
+// a SpanRecording is in scope, the start and end times of the scope are also
+// recorded as a span.
+//
+// If the SpanRecording doesn't sample the request, i.e., the root scope, the
+// scope is still added to GetContext, so log lines keep their context prefix,
+// but it doesn't get a span ID or read the clock.
 class Tracing : public capture_thread::ThreadCapture<Tracing> {
  public:
-  explicit Tracing(std::string name)
-      : name_(std::move(name)), cross_and_capture_to_(this) {}
+  explicit Tracing(const TraceName* name) : Tracing(Name{name, nullptr, 0}) {}
+
+  // For string literals and __func__. This also matches char buffers that are
+  // filled in at runtime, so the size is taken from the terminating null
+  // rather than from kSize.
+  template <std::size_t kSize>
+  explicit Tracing(const char (&name)[kSize])
+      : Tracing(Name{nullptr, name, std::char_traits<char>::length(name)}) {}
+
+  // NOTE: Names, and the paths that contain them, are interned permanently
+  // the first time they're used, whether or not the request is sampled. Using
+  // names that vary per request, e.g., that contain a request ID, grows memory
+  // without bound. Put such values in the log message instead.
+  explicit Tracing(const std::string& name)
+      : Tracing(Name{nullptr, name.data(), name.size()}) {}
+
+  ~Tracing();
 
   // Returns the current context as a ":"-joined concatenation of the names of
   // the current Tracing objects in scope. For example:
@@ -58,14 +111,57 @@ class Tracing : public capture_thread::ThreadCapture<Tracing> {
   //   Tracing scope1("scope1");
   //   Tracing scope2("scope2");
   //   std::cerr << Tracing::GetContext();  // "scope1:scope2"
-  static std::string GetContext();
+  //
+  // The path of each scope is interned along with its name, so this takes
+  // constant time, and the reference remains valid indefinitely.
+  static const std::string& GetContext();
 
- private:
-  const std::string& name() const { return name_; }
+  // Returns false if the current request wasn't sampled. This can be used to
+  // skip computing names or annotations that would be ignored.
+  static bool IsSampled() { return !GetCurrent() || GetCurrent()->sampled_; }
 
-  static void ReverseTrace(const Tracing* tracer, Formatter* formatter);
+  const TraceName* name() const { return path_->name; }
 
-  const std::string name_;
+ private:
+  // Either an interned name, or text that still needs to be interned.
+  struct Name {
+    const TraceName* interned;
+    const char* data;
+    std::size_t size;
+  };
+
+  // The interned path of a scope, i.e., its name and its parent's path.
+  struct Path {
+    // Returns the unique Path for the given parent and name.
+    static const Path* Intern(const Path* parent, const TraceName* name);
+
+    const Path* const parent;
+    const TraceName* const name;
+    const std::string text;
+    const Path* next;
+  };
+
+  explicit Tracing(const Name& name)
+      : path_(Enter(GetCurrent(), name)),
+        sampled_(GetCurrent() ? GetCurrent()->sampled_
+                              : SpanRecording::SampleRoot()),
+        parent_span_(sampled_ && GetCurrent() ? GetCurrent()->span_ : 0),
+        span_(sampled_ && SpanRecording::IsActive()
+                  ? SpanRecording::NewSpanId()
+                  : 0),
+        start_ns_(span_ ? SpanRecording::NowNs() : 0),
+        cross_and_capture_to_(this) {}
+
+  // Returns the path of a new scope.
+  static const Path* Enter(const Tracing* parent, const Name& name);
+
+  const Path* const path_;
+  // The sampling decision is only made at the root, and is inherited by the
+  // rest of the scopes of the request.
+  const bool sampled_;
+  const std::uint64_t parent_span_;
+  const std::uint64_t span_;
+  const std::int64_t start_ns_;
   const AutoThreadCrosser cross_and_capture_to_;
 };
 
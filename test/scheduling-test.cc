@@ -0,0 +1,361 @@
+/* -----------------------------------------------------------------------------
+Copyright 2017 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+----------------------------------------------------------------------------- */
+
+// Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "thread-crosser.h"
+
+#include "callback-queue.h"
+#include "cancellation-scope.h"
+#include "log-text.h"
+#include "task-graph.h"
+#include "thread-pool.h"
+#include "timer-wheel.h"
+
+using testing::ElementsAre;
+
+namespace capture_thread {
+
+using testing::CallbackQueue;
+using testing::CancellationScope;
+using testing::LogText;
+using testing::LogTextMultiThread;
+using testing::TaskGraph;
+using testing::ThreadPool;
+using testing::TimerWheel;
+
+TEST(TimerWheelTest, CallbacksRunInOrderWithCallerContext) {
+  LogTextMultiThread logger;
+  CallbackQueue queue;
+  std::thread worker([&queue] {
+    while (queue.PopAndCall()) {
+    }
+  });
+
+  {
+    TimerWheel timers(&queue);
+    timers.RunAfter(std::chrono::milliseconds(30),
+                    [] { LogText::Log("logged 2"); });
+    timers.RunAfter(std::chrono::milliseconds(10),
+                    [] { LogText::Log("logged 1"); });
+    // Long enough to require cascading from a higher level of the wheel.
+    timers.RunAfter(std::chrono::milliseconds(100),
+                    [] { LogText::Log("logged 3"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+
+  queue.WaitUntilEmpty();
+  queue.Terminate();
+  worker.join();
+
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("logged 1", "logged 2", "logged 3"));
+}
+
+TEST(TimerWheelTest, CancelledCallbacksAreNotRun) {
+  LogTextMultiThread logger;
+  CallbackQueue queue;
+  std::thread worker([&queue] {
+    while (queue.PopAndCall()) {
+    }
+  });
+
+  {
+    TimerWheel timers(&queue);
+    const auto cancelled = timers.RunAfter(std::chrono::milliseconds(10),
+                                           [] { LogText::Log("cancelled"); });
+    timers.RunAfter(std::chrono::milliseconds(20),
+                    [] { LogText::Log("logged 1"); });
+    EXPECT_TRUE(timers.Cancel(cancelled));
+    EXPECT_FALSE(timers.Cancel(cancelled));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  queue.WaitUntilEmpty();
+  queue.Terminate();
+  worker.join();
+
+  EXPECT_THAT(logger.GetLines(), ElementsAre("logged 1"));
+}
+
+TEST(TaskGraphTest, TasksRunAfterDependenciesWithBuilderContext) {
+  CallbackQueue queue;
+  std::list<std::unique_ptr<std::thread>> threads;
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back(new std::thread([&queue] {
+      while (queue.PopAndCall()) {
+      }
+    }));
+  }
+
+  LogTextMultiThread logger;
+  TaskGraph graph;
+  const auto first = graph.AddTask([] { LogText::Log("first"); });
+  const auto left = graph.AddTask([] { LogText::Log("middle"); }, {first});
+  const auto right = graph.AddTask([] { LogText::Log("middle"); }, {first});
+  graph.AddTask([] { LogText::Log("last"); }, {left, right});
+
+  graph.Execute(&queue);
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("first", "middle", "middle", "last"));
+
+  // The graph can be executed again, with the same context.
+  graph.Execute(&queue);
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("first", "middle", "middle", "last", "first",
+                          "middle", "middle", "last"));
+
+  queue.Terminate();
+  for (const auto& thread : threads) {
+    thread->join();
+  }
+}
+
+TEST(TaskGraphTest, GraphCanBeDestroyedAsSoonAsExecuteReturns) {
+  CallbackQueue queue;
+  std::list<std::unique_ptr<std::thread>> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back(new std::thread([&queue] {
+      while (queue.PopAndCall()) {
+      }
+    }));
+  }
+
+  std::atomic<int> executed(0);
+  for (int i = 0; i < 1000; ++i) {
+    std::unique_ptr<TaskGraph> graph(new TaskGraph);
+    const auto first = graph->AddTask([&executed] { ++executed; });
+    // Independent tasks, so that different workers finish at the same time.
+    for (int j = 0; j < 4; ++j) {
+      graph->AddTask([&executed] { ++executed; }, {first});
+    }
+    graph->Execute(&queue);
+    graph.reset();
+  }
+  EXPECT_EQ(5000, executed);
+
+  queue.Terminate();
+  for (const auto& thread : threads) {
+    thread->join();
+  }
+}
+
+TEST(ThreadPoolTest, WorkersStartInPoolContext) {
+  LogTextMultiThread logger;
+  ThreadPool pool(1, 1);
+  {
+    // Not captured by the workers, since it isn't in scope for the pool.
+    LogTextMultiThread masked;
+    // Callbacks aren't wrapped, so they run in the context of the workers.
+    pool.Push([] { LogText::Log("logged 1"); });
+    pool.WaitUntilEmpty();
+    EXPECT_THAT(masked.GetLines(), ElementsAre());
+  }
+  EXPECT_THAT(logger.GetLines(), ElementsAre("logged 1"));
+}
+
+TEST(ThreadPoolTest, GrowsUnderLoadAndShrinksWhenIdle) {
+  std::mutex lock;
+  std::condition_variable wait;
+  int started = 0;
+  bool released = false;
+  const auto blocked = [&] {
+    std::unique_lock<std::mutex> locked(lock);
+    ++started;
+    wait.notify_all();
+    wait.wait(locked, [&] { return released; });
+  };
+
+  ThreadPool pool(0, 3, std::chrono::milliseconds(1),
+                  std::chrono::milliseconds(1));
+  EXPECT_EQ(pool.ThreadCount(), 0);
+  // No callbacks are pushed or finish after these, so new workers can only be
+  // started by the monitor.
+  for (int i = 0; i < 4; ++i) {
+    pool.Push(blocked);
+  }
+  {
+    std::unique_lock<std::mutex> locked(lock);
+    wait.wait(locked, [&] { return started == 3; });
+  }
+  EXPECT_EQ(pool.ThreadCount(), 3);
+
+  {
+    std::lock_guard<std::mutex> locked(lock);
+    released = true;
+    wait.notify_all();
+  }
+  pool.WaitUntilEmpty();
+  EXPECT_EQ(started, 4);
+  // Workers retire after idle_timeout without anything to execute.
+  while (pool.ThreadCount() > 0) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(ThreadPoolTest, ShrinksWhenLoadDropsButDoesNotStop) {
+  std::mutex lock;
+  std::condition_variable wait;
+  int started = 0;
+  bool released = false;
+  const auto blocked = [&] {
+    std::unique_lock<std::mutex> locked(lock);
+    ++started;
+    wait.notify_all();
+    wait.wait(locked, [&] { return released; });
+  };
+
+  ThreadPool pool(0, 3, std::chrono::milliseconds(1),
+                  std::chrono::milliseconds(50));
+  for (int i = 0; i < 3; ++i) {
+    pool.Push(blocked);
+  }
+  {
+    std::unique_lock<std::mutex> locked(lock);
+    wait.wait(locked, [&] { return started == 3; });
+    released = true;
+    wait.notify_all();
+  }
+  pool.WaitUntilEmpty();
+  EXPECT_EQ(pool.ThreadCount(), 3);
+
+  // A callback every 5ms keeps one worker busy far more often than
+  // idle_timeout, but only needs one worker.
+  const auto give_up = ThreadPool::Clock::now() + std::chrono::seconds(10);
+  while (pool.ThreadCount() > 1 && ThreadPool::Clock::now() < give_up) {
+    pool.Push([] {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(pool.ThreadCount(), 1);
+}
+
+TEST(ThreadPoolTest, WorkerScopeWrapsEachWorker) {
+  LogTextMultiThread logger;
+  {
+    ThreadPool pool(1, 1, std::chrono::milliseconds(10),
+                    std::chrono::seconds(10),
+                    [](int id, const std::function<void()>& run) {
+                      LogText::Log("starting " + std::to_string(id));
+                      run();
+                      LogText::Log("stopping " + std::to_string(id));
+                    });
+    pool.Push(ThreadCrosser::WrapCall([] { LogText::Log("callback"); }));
+    pool.WaitUntilEmpty();
+  }
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("starting 0", "callback", "stopping 0"));
+}
+
+TEST(ThreadPoolTest, WorkerScopeCanUseThePoolAfterRetiring) {
+  ThreadPool* pool_in_scope = nullptr;
+  std::atomic<bool> pushing(false);
+  std::atomic<bool> used_pool(false);
+  ThreadPool pool(
+      0, 1, std::chrono::milliseconds(1), std::chrono::milliseconds(1),
+      [&pool_in_scope, &pushing, &used_pool](
+          int id, const std::function<void()>& run) {
+        run();
+        if (id == 0) {
+          while (!pushing) {
+            std::this_thread::yield();
+          }
+          // Gives the Push below time to start a new worker. This deadlocks
+          // if the pool holds its lock while joining retired workers.
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          pool_in_scope->ThreadCount();
+          used_pool = true;
+        }
+      });
+  pool_in_scope = &pool;
+  pool.Push([] {});
+  pool.WaitUntilEmpty();
+  // Worker 0 retires, and then waits in its WorkerScope.
+  while (pool.ThreadCount() > 0) {
+    std::this_thread::yield();
+  }
+  pushing = true;
+  pool.Push([] {});
+  pool.WaitUntilEmpty();
+  while (!used_pool) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(CancellationScopeTest, PendingCallbacksSkippedAfterScopeEnds) {
+  LogTextMultiThread logger;
+  CallbackQueue queue(false /*active*/);
+  queue.Push(CancellationScope::WrapCall([] { LogText::Log("logged 1"); }));
+  {
+    CancellationScope scope;
+    queue.Push(CancellationScope::WrapCall([] { LogText::Log("cancelled"); }));
+  }
+  queue.Push(CancellationScope::WrapCall([] { LogText::Log("logged 2"); }));
+
+  std::thread worker([&queue] {
+    while (queue.PopAndCall()) {
+    }
+  });
+  queue.Activate();
+  queue.WaitUntilEmpty();
+  queue.Terminate();
+  worker.join();
+
+  EXPECT_THAT(logger.GetLines(), ElementsAre("logged 1", "logged 2"));
+}
+
+TEST(CancellationScopeTest, CancelAppliesToNestedScopes) {
+  LogTextMultiThread logger;
+  CallbackQueue queue(false /*active*/);
+  CancellationScope outer;
+  {
+    CancellationScope inner;
+    queue.Push(CancellationScope::WrapCall([] { LogText::Log("cancelled"); }));
+    EXPECT_FALSE(CancellationScope::IsCancelled());
+    outer.Cancel();
+    EXPECT_TRUE(CancellationScope::IsCancelled());
+
+    std::thread worker([&queue] {
+      while (queue.PopAndCall()) {
+      }
+    });
+    queue.Activate();
+    queue.WaitUntilEmpty();
+    queue.Terminate();
+    worker.join();
+  }
+
+  EXPECT_THAT(logger.GetLines(), ElementsAre());
+}
+
+}  // namespace capture_thread
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -16,7 +16,9 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -27,9 +29,11 @@ limitations under the License.
 #include "log-values.h"
 
 using testing::ElementsAre;
+using testing::ElementsAreArray;
 
 namespace capture_thread {
 
+using testing::LineView;
 using testing::LogText;
 using testing::LogTextSingleThread;
 using testing::LogValues;
@@ -89,6 +93,34 @@ TEST(ThreadCaptureTest, ManualThreadCrossing) {
   EXPECT_THAT(logger.GetLines(), ElementsAre("logged 1", "logged 2"));
 }
 
+TEST(ThreadCaptureTest, LogOverloadsCopyOnlyWhenCaptured) {
+  const std::string text("logged 1, logged 2");
+  LogText::Log(LineView(text.data(), 8));
+  LogTextSingleThread logger;
+  LogText::Log(LineView(text.data(), 8));
+  LogText::Log(LineView(text.data() + 10, 8));
+  LogText::Log("logged 3");
+  LogText::Log(std::string("logged 4"));
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("logged 1", "logged 2", "logged 3", "logged 4"));
+}
+
+TEST(ThreadCaptureTest, ManyAndLargeEntriesAreKeptInOrder) {
+  LogTextSingleThread text_logger;
+  LogValuesSingleThread count_logger;
+  std::vector<std::string> expected_lines;
+  std::vector<int> expected_counts;
+  for (int i = 0; i < 1000; ++i) {
+    // Includes lines that are empty or larger than the internal block size.
+    expected_lines.emplace_back(i % 100 == 0 ? 10000 : i % 10, 'x');
+    expected_counts.emplace_back(i);
+    LogText::Log(expected_lines.back());
+    LogValues::Count(i);
+  }
+  EXPECT_THAT(text_logger.GetLines(), ElementsAreArray(expected_lines));
+  EXPECT_THAT(count_logger.GetCounts(), ElementsAreArray(expected_counts));
+}
+
 }  // namespace capture_thread
 
 int main(int argc, char* argv[]) {
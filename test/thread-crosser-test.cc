@@ -16,8 +16,15 @@ limitations under the License.
 
 // Author: Kevin P. Barry [ta0kira@gmail.com] [kevinbarry@google.com]
 
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -28,17 +35,29 @@ limitations under the License.
 #include "callback-queue.h"
 #include "log-text.h"
 #include "log-values.h"
+#include "lz-codec.h"
+#include "mapped-log-file.h"
 
 using testing::ElementsAre;
+using testing::ElementsAreArray;
+using testing::MatchesRegex;
 
 namespace capture_thread {
 
 using testing::CallbackQueue;
 using testing::LogText;
+using testing::LogTextCompressed;
+using testing::LogTextMappedFile;
 using testing::LogTextMultiThread;
+using testing::LogTextPerThread;
+using testing::LogTextRing;
 using testing::LogTextSingleThread;
 using testing::LogValues;
+using testing::LogValuesAggregate;
 using testing::LogValuesMultiThread;
+using testing::LzCompress;
+using testing::LzDecompress;
+using testing::MappedLogFile;
 
 TEST(ThreadCrosserTest, WrapCallIsFineWithoutLogger) {
   bool called = false;
@@ -388,6 +407,222 @@ TEST(ThreadCrosserTest, ReverseOrderOfLoggersOnStack) {
   EXPECT_THAT(logger3.GetLines(), ElementsAre());
 }
 
+TEST(LogTextMultiThreadTest, DrainRemovesCapturedLines) {
+  LogTextMultiThread logger;
+  LogText::Log("logged 1");
+
+  std::thread worker(ThreadCrosser::WrapCall([] { LogText::Log("logged 2"); }));
+  worker.join();
+
+  EXPECT_THAT(logger.Drain(), ElementsAre("logged 1", "logged 2"));
+  EXPECT_THAT(logger.GetLines(), ElementsAre());
+  LogText::Log("logged 3");
+  EXPECT_THAT(logger.Drain(), ElementsAre("logged 3"));
+}
+
+TEST(LogTextRingTest, KeepsMostRecentLines) {
+  LogTextRing logger(3 /*max_lines*/, 20 /*max_bytes*/);
+  LogText::Log("logged 1");
+
+  std::thread worker(ThreadCrosser::WrapCall([] {
+    LogText::Log("logged 2");
+    LogText::Log("logged 3");
+  }));
+  worker.join();
+
+  // Limited by the number of bytes. "logged 3" wraps around the end of the
+  // buffer.
+  EXPECT_THAT(logger.GetLines(), ElementsAre("logged 2", "logged 3"));
+  LogText::Log("4");
+  LogText::Log("5");
+  // Limited by the number of lines.
+  EXPECT_THAT(logger.GetLines(), ElementsAre("logged 3", "4", "5"));
+  LogText::Log("this line is truncated");
+  EXPECT_THAT(logger.GetLines(), ElementsAre("this line is truncat"));
+  EXPECT_EQ(logger.GetOverwritten(), 5);
+}
+
+TEST(LogTextMappedFileTest, RollsOverSegments) {
+  const std::string prefix =
+      ::testing::TempDir() + "mapped-" + std::to_string(getpid());
+  std::vector<std::string> contents;
+  {
+    MappedLogFile file(prefix, 16 /*segment_size*/);
+    LogTextMappedFile logger(&file);
+    LogText::Log("logged 1");
+
+    std::thread worker(ThreadCrosser::WrapCall([] {
+      LogText::Log("logged 2");
+      LogText::Log("this line is truncated");
+    }));
+    worker.join();
+    EXPECT_EQ(0, file.GetDropped());
+
+    // Full segments are released without waiting for the file to be destroyed.
+    std::ifstream first(file.SegmentPath(0));
+    std::ostringstream first_text;
+    first_text << first.rdbuf();
+    EXPECT_EQ("logged 1\n", first_text.str());
+
+    for (int i = 0; i < 3; ++i) {
+      contents.push_back(file.SegmentPath(i));
+    }
+  }
+
+  // Each segment is truncated to its contents once the file is destroyed.
+  for (std::string& path : contents) {
+    std::ifstream segment(path);
+    std::ostringstream text;
+    text << segment.rdbuf();
+    unlink(path.c_str());
+    path = text.str();
+  }
+  EXPECT_THAT(contents, ElementsAre("logged 1\n", "logged 2\n",
+                                    "this line is tr\n"));
+}
+
+TEST(LzCodecTest, RoundTrip) {
+  std::string repetitive;
+  for (int i = 0; i < 1000; ++i) {
+    repetitive += "line " + std::to_string(i % 7) + " of the log\n";
+  }
+  std::string binary;
+  for (int i = 0; i < 5000; ++i) {
+    binary.push_back(static_cast<char>(i * 7919 % 251));
+  }
+  for (const std::string& original :
+       std::vector<std::string>{"", "abc", std::string(1000, 'x'),
+                                repetitive, binary}) {
+    std::string compressed;
+    LzCompress(original.data(), original.size(), &compressed);
+    std::string decompressed;
+    EXPECT_TRUE(
+        LzDecompress(compressed.data(), compressed.size(), &decompressed));
+    EXPECT_EQ(original, decompressed);
+  }
+
+  std::string compressed;
+  LzCompress(repetitive.data(), repetitive.size(), &compressed);
+  EXPECT_LT(compressed.size(), repetitive.size() / 10);
+  std::string decompressed;
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed.size() - 1,
+                            &decompressed));
+}
+
+TEST(LogTextCompressedTest, KeepsAllLines) {
+  std::vector<std::string> expected;
+  LogTextCompressed logger(1024 /*chunk_size*/);
+  std::thread worker(ThreadCrosser::WrapCall([&expected] {
+    for (int i = 0; i < 1000; ++i) {
+      expected.push_back("logged " + std::to_string(i));
+      LogText::Log(expected.back());
+    }
+  }));
+  worker.join();
+
+  EXPECT_THAT(logger.GetLines(), ElementsAreArray(expected));
+
+  std::size_t total_size = 0;
+  for (const std::string& line : expected) {
+    total_size += line.size();
+  }
+  // Waits for the compressor thread to catch up.
+  std::size_t stored = 0;
+  for (int i = 0; i < 100; ++i) {
+    stored = logger.GetStoredBytes();
+    if (stored < total_size / 2) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_LT(stored, total_size / 2);
+  EXPECT_THAT(logger.GetLines(), ElementsAreArray(expected));
+}
+
+TEST(LogTextPerThreadTest, MergesThreads) {
+  LogTextPerThread logger;
+  LogText::Log("logged 1");
+
+  std::thread worker(ThreadCrosser::WrapCall([] {
+    LogText::Log("logged 2");
+    LogText::Log("logged 3");
+  }));
+  worker.join();
+  LogText::Log("logged 4");
+
+  EXPECT_THAT(logger.GetLines(),
+              ElementsAre("logged 1", "logged 4", "logged 2", "logged 3"));
+  EXPECT_THAT(logger.Drain(),
+              ElementsAre("logged 1", "logged 4", "logged 2", "logged 3"));
+  EXPECT_THAT(logger.GetLines(), ElementsAre());
+}
+
+TEST(LogTextPerThreadTest, OrderedMergesByTime) {
+  LogTextPerThread logger(true /*ordered*/);
+  LogText::Log("logged 1");
+
+  std::thread worker(ThreadCrosser::WrapCall([] {
+    for (int i = 0; i < 100; ++i) {
+      LogText::Log("worker");
+    }
+  }));
+  worker.join();
+  LogText::Log("logged 2");
+
+  const auto lines = logger.Drain();
+  ASSERT_EQ(lines.size(), 102);
+  EXPECT_EQ(lines.front(), "logged 1");
+  EXPECT_EQ(lines.back(), "logged 2");
+
+  LogText::Log("logged 3");
+  EXPECT_THAT(logger.Drain(), ElementsAre("logged 3"));
+}
+
+TEST(LogTextPerThreadTest, StampedPrefixesThreadAndTime) {
+  LogTextPerThread logger(true /*ordered*/, true /*stamped*/);
+  LogText::Log("logged 1");
+  std::thread worker(ThreadCrosser::WrapCall([] { LogText::Log("logged 2"); }));
+  worker.join();
+
+  const auto lines = logger.Drain();
+  ASSERT_EQ(lines.size(), 2);
+  // e.g., "[1234.567890 T1] logged 1"
+  EXPECT_THAT(lines.front().str(),
+              MatchesRegex("\\[[0-9]+\\.[0-9]{6} T[0-9]+\\] logged 1"));
+  EXPECT_THAT(lines.back().str(),
+              MatchesRegex("\\[[0-9]+\\.[0-9]{6} T[0-9]+\\] logged 2"));
+  // The threads have different IDs.
+  const auto thread_id = [](const std::string& line) {
+    const std::size_t start = line.find(" T") + 1;
+    return line.substr(start, line.find(']') - start);
+  };
+  EXPECT_THAT(thread_id(lines.front().str()), MatchesRegex("T[0-9]+"));
+  EXPECT_NE(thread_id(lines.front().str()), thread_id(lines.back().str()));
+}
+
+TEST(LogValuesAggregateTest, CombinesThreads) {
+  LogValuesAggregate logger;
+  LogValues::Count(-1);
+  LogValues::Count(1);
+
+  std::thread worker(ThreadCrosser::WrapCall([] {
+    LogValues::Count(2);
+    LogValues::Count(3);
+    LogValues::Count(1000);
+  }));
+  worker.join();
+
+  const auto summary = logger.GetSummary();
+  EXPECT_EQ(summary.count, 5);
+  EXPECT_EQ(summary.sum, 1005);
+  EXPECT_EQ(summary.min, -1);
+  EXPECT_EQ(summary.max, 1000);
+  EXPECT_EQ(summary.histogram[0], 1);
+  EXPECT_EQ(summary.histogram[1], 1);
+  EXPECT_EQ(summary.histogram[2], 2);
+  EXPECT_EQ(summary.histogram[10], 1);
+}
+
 }  // namespace capture_thread
 
 int main(int argc, char* argv[]) {